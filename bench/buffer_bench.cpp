@@ -0,0 +1,149 @@
+// Compares the editor's text storage backends (piece table and rope) with the
+// vector<string> row storage the editor used before, on random character
+// inserts, Enter (line split) and Backspace at column 0 (line join), plus the
+// memory each one holds afterwards and the time it takes to free it.
+//
+// Usage: tedit_bench [--ops N] [lines...]   (default: 1000000 10000000 lines)
+#include "piecetable.h"
+#include "rope.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+using namespace std;
+
+// The editor's previous storage, with the same operations it used to perform.
+struct VectorRows {
+    vector<string> rows;
+
+    void load(const string& text) {
+        rows.clear();
+        size_t start = 0;
+        while(true) {
+            size_t end = text.find('\n', start);
+            if(end == string::npos) {
+                rows.push_back(text.substr(start));
+                break;
+            }
+            rows.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+    int lineCount() const { return rows.size(); }
+    int lineLength(int y) const { return rows[y].size(); }
+    void insertChar(int y, int x, char ch) { rows[y].insert(rows[y].begin() + x, ch); }
+    void splitLine(int y, int x) {
+        string suffix = rows[y].substr(x);
+        rows[y].erase(x);
+        rows.insert(rows.begin() + y + 1, suffix);
+    }
+    void joinLine(int y) {
+        rows[y - 1] += rows[y];
+        rows.erase(rows.begin() + y);
+    }
+};
+
+// Drives PieceTable/Rope the way Editor::insertTextAt/deleteRangeAt do.
+template<class Buffer>
+struct BufferRows {
+    Buffer buffer;
+
+    void load(const string& text) { buffer.load(text); }
+    int lineCount() const { return buffer.lineCount(); }
+    int lineLength(int y) const { return buffer.lineLength(y); }
+    void insertChar(int y, int x, char ch) { buffer.insert(buffer.lineStart(y) + x, string(1, ch)); }
+    void splitLine(int y, int x) { buffer.insert(buffer.lineStart(y) + x, "\n"); }
+    void joinLine(int y) { buffer.erase(buffer.lineStart(y) - 1, 1); }
+};
+
+static double elapsedNs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+// Resident set size of the process in MB
+static double residentMb() {
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return (double)resident * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+template<class Rows>
+static void run(const char* name, const string& text, int ops) {
+    double baseMb = residentMb();
+    unique_ptr<Rows> owner(new Rows);
+    Rows& rows = *owner;
+    auto start = chrono::steady_clock::now();
+    rows.load(text);
+    double loadMs = elapsedNs(start) / 1e6;
+
+    mt19937 rng(42);
+    auto randomRow = [&](int from) { return from + (int)(rng() % (rows.lineCount() - from)); };
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < ops; i++) {
+        int y = randomRow(0);
+        rows.insertChar(y, rng() % (rows.lineLength(y) + 1), 'x');
+    }
+    double insertNs = elapsedNs(start) / ops;
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < ops; i++) {
+        int y = randomRow(0);
+        rows.splitLine(y, rng() % (rows.lineLength(y) + 1));
+    }
+    double enterNs = elapsedNs(start) / ops;
+
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < ops; i++) rows.joinLine(randomRow(1));
+    double joinNs = elapsedNs(start) / ops;
+
+    double rssMb = residentMb() - baseMb;
+    start = chrono::steady_clock::now();
+    owner.reset();
+    double freeMs = elapsedNs(start) / 1e6;
+#ifdef __GLIBC__
+    malloc_trim(0); // so the next run starts from the same resident size
+#endif
+
+    cout << "  " << left << setw(12) << name << right << fixed << setprecision(1)
+         << setw(12) << loadMs << setw(14) << insertNs << setw(14) << enterNs << setw(14) << joinNs
+         << setw(10) << rssMb << setw(10) << freeMs << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    int ops = 2000;
+    vector<int> sizes;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--ops" && i + 1 < argc) ops = atoi(argv[++i]);
+        else sizes.push_back(atoi(argv[i]));
+    }
+    if(sizes.empty()) sizes = {1000000, 10000000};
+
+    for(int lines : sizes) {
+        string text;
+        text.reserve((size_t)lines * 40);
+        for(int i = 0; i < lines; i++) {
+            text += "line " + to_string(i) + ": the quick brown fox jumps";
+            if(i + 1 < lines) text += '\n';
+        }
+
+        cout << lines << " lines, " << text.size() / (1024 * 1024) << " MB, " << ops << " ops each\n";
+        cout << "  " << left << setw(12) << "storage" << right << setw(12) << "load ms"
+             << setw(14) << "insert ns/op" << setw(14) << "enter ns/op" << setw(14) << "join ns/op" << setw(10) << "RSS MB" << setw(10) << "free ms" << "\n";
+        run<VectorRows>("vector", text, ops);
+        run<BufferRows<PieceTable>>("piece table", text, ops);
+        run<BufferRows<Rope>>("rope", text, ops);
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Measures what it costs to put a screen of highlighted text on the terminal:
+// bytes sent per frame and ns per screen cell. The renderer the editor used
+// before (an escape sequence looked up in the theme and built for every
+// character, whole screen every frame) is compared with the cell grid, which
+// takes its escapes from the theme's compiled table and sends only what
+// changed. Lines are highlighted up front, so only drawing is measured.
+//
+// Usage: tedit_render_bench [file]   (default: src/editor.cpp)
+#include "screen.h"
+#include "syntax.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+
+static const int ROWS = 24, COLS = 80;
+
+struct Text {
+    vector<string> lines;
+    vector<vector<uint8_t>> types;
+
+    void highlight(int y) { Syntax::updateSyntax(lines[y], types[y]); }
+};
+
+// The editor's previous renderer
+static void perCharFrame(Text& text, int rowOffset, string& out) {
+    out += "\x1b[?25l\x1b[H";
+    for(int y = 0; y < ROWS - 1; y++) {
+        int fileRow = y + rowOffset;
+        if(fileRow >= (int)text.lines.size()) {
+            out += "~\r\n";
+            continue;
+        }
+        const string& line = text.lines[fileRow];
+        int drawLen = min((int)line.size(), COLS);
+        for(int i = 0; i < drawLen; i++) {
+            switch(text.types[fileRow][i]) {
+                case HL_NORMAL: out += "\x1b[39m"; break;
+                case HL_KEYWORD: out += "\x1b[" + Syntax::currentTheme.colors["keyword"] + "m"; break;
+                case HL_NUMBER: out += "\x1b[" + Syntax::currentTheme.colors["number"] + "m"; break;
+                case HL_STRING: out += "\x1b[" + Syntax::currentTheme.colors["string"] + "m"; break;
+                case HL_COMMENT: out += "\x1b[" + Syntax::currentTheme.colors["comment"] + "m"; break;
+            }
+            out += line[i];
+        }
+        out += "\x1b[39m\x1b[K\r\n";
+    }
+    out += "\x1b[7m status \x1b[m\x1b[H\x1b[?25h";
+}
+
+static void gridFrame(Screen& screen, Text& text, int rowOffset, const vector<string>& palette, FrameBuffer& out) {
+    for(int y = 0; y < ROWS - 1; y++) {
+        screen.clearRow(y);
+        int fileRow = y + rowOffset;
+        if(fileRow >= (int)text.lines.size()) {
+            screen.put(y, 0, '~', 0);
+            continue;
+        }
+        const string& line = text.lines[fileRow];
+        int drawLen = min((int)line.size(), COLS);
+        for(int i = 0; i < drawLen; i++) screen.put(y, i, line[i] == '\t' ? ' ' : line[i], text.types[fileRow][i]);
+    }
+    screen.text(ROWS - 1, 0, " status", HL_TYPES);
+    screen.present(out, palette, 0, 0);
+}
+
+static vector<string> compiledPalette() {
+    vector<string> palette(Syntax::currentTheme.escapes.begin(), Syntax::currentTheme.escapes.end());
+    palette.push_back("\x1b[0;7m");
+    return palette;
+}
+
+// How the editor built the palette before themes were compiled, every frame
+static vector<string> lookedUpPalette() {
+    auto color = [](const string& type) {
+        auto it = Syntax::currentTheme.colors.find(type);
+        return "\x1b[0;" + (it != Syntax::currentTheme.colors.end() ? it->second : string("39")) + "m";
+    };
+    return {"\x1b[m", color("keyword"), color("number"), color("string"), color("comment"), "\x1b[0;7m"};
+}
+
+// Runs frame(i), which returns the bytes it sent, for at least ~100 ms
+static void measure(const string& label, const function<size_t(int)>& frame) {
+    int frames = 0;
+    size_t bytes = 0;
+    auto start = chrono::steady_clock::now();
+    double seconds = 0;
+    do {
+        bytes += frame(frames++);
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while(seconds < 0.1);
+    cout << "  " << left << setw(44) << label << right << fixed << setprecision(1)
+         << setw(14) << (double)bytes / frames << setw(12) << seconds * 1e9 / frames / (ROWS * COLS) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    setenv("TEDIT_DATA_DIR", TEDIT_SOURCE_DIR, 0);
+    string path = argc > 1 ? argv[1] : string(TEDIT_SOURCE_DIR) + "/src/editor.cpp";
+    ifstream file(path);
+    if(!file) {
+        cerr << "cannot read " << path << "\n";
+        return 1;
+    }
+    Syntax::loadLanguage(path);
+    Syntax::loadTheme("default");
+
+    Text text;
+    for(string line; getline(file, line);) text.lines.push_back(line);
+    if(text.lines.empty()) text.lines.push_back("");
+    text.types.resize(text.lines.size());
+    for(int y = 0; y < (int)text.lines.size(); y++) text.highlight(y);
+    int pages = max(1, (int)text.lines.size() - ROWS);
+
+    cout << path << ", " << ROWS << "x" << COLS << " screen\n";
+    cout << "  " << left << setw(44) << "renderer" << right << setw(14) << "bytes/frame" << setw(12) << "ns/cell" << "\n";
+
+    string out;
+    measure("per-character escapes (any frame)", [&](int i) {
+        out.clear();
+        perCharFrame(text, i % pages, out);
+        return out.size();
+    });
+
+    Screen screen;
+    screen.resize(ROWS, COLS);
+    FrameBuffer frame; // measured, never written
+    vector<string> palette = compiledPalette();
+    auto sent = [&]() {
+        size_t bytes = frame.size();
+        frame.clear();
+        return bytes;
+    };
+
+    measure("cell grid, full repaint", [&](int i) {
+        screen.invalidate();
+        gridFrame(screen, text, i % pages, palette, frame);
+        return sent();
+    });
+
+    // Typing on one row: the row is highlighted again, everything else is unchanged
+    int editRow = min(10, (int)text.lines.size() - 1);
+    auto edit = [&](int i) {
+        if(i % 2 == 0) text.lines[editRow].insert(0, "x");
+        else text.lines[editRow].erase(0, 1);
+        text.highlight(editRow);
+    };
+    gridFrame(screen, text, 0, palette, frame);
+    sent();
+    measure("cell grid, one-character edit", [&](int i) {
+        edit(i);
+        gridFrame(screen, text, 0, palette, frame);
+        return sent();
+    });
+    measure("cell grid, one-character edit, looked up", [&](int i) {
+        edit(i);
+        gridFrame(screen, text, 0, lookedUpPalette(), frame);
+        return sent();
+    });
+
+    measure("cell grid, scroll one line", [&](int i) {
+        gridFrame(screen, text, i % pages, palette, frame);
+        return sent();
+    });
+    screen.useScrollRegions(true);
+    measure("cell grid, scroll one line, scroll region", [&](int i) {
+        if(i % pages != 0) screen.scroll(0, ROWS - 1, 1);
+        gridFrame(screen, text, i % pages, palette, frame);
+        return sent();
+    });
+    return 0;
+}
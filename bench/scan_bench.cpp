@@ -0,0 +1,74 @@
+// Measures line-break scanning throughput (GB/s) for every scanner the CPU
+// supports, on real files and on synthetic inputs with short, long and CRLF
+// lines.
+//
+// Usage: tedit_scan_bench [files...]   (default: the files in test/)
+#include "linescan.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+namespace fs = std::filesystem;
+
+static string synthetic(size_t bytes, size_t avgLine, const char* eol) {
+    mt19937 rng(7);
+    string text;
+    text.reserve(bytes + avgLine * 2);
+    while(text.size() < bytes) {
+        size_t len = rng() % (avgLine * 2);
+        for(size_t i = 0; i < len; i++) text += (char)('a' + rng() % 26);
+        text += eol;
+    }
+    return text;
+}
+
+static void measure(const string& label, const string& text) {
+    cout << "  " << left << setw(28) << label;
+    vector<size_t> breaks;
+    for(const LineScanner& s : lineScanners()) {
+        // repeat small inputs so every measurement runs for at least ~100 ms
+        size_t rounds = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            breaks.clear();
+            s.scan(text.data(), 0, text.size(), breaks);
+            rounds++;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while(seconds < 0.1);
+        double gbps = (double)text.size() * rounds / seconds / 1e9;
+        cout << right << setw(10) << fixed << setprecision(2) << gbps;
+    }
+    cout << "   (" << breaks.size() << " lines)\n";
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> files(argv + 1, argv + argc);
+    if(files.empty()) {
+        for(auto& entry : fs::directory_iterator(TEDIT_TEST_DIR)) files.push_back(entry.path().string());
+    }
+
+    cout << "  " << left << setw(28) << "input (GB/s)";
+    for(const LineScanner& s : lineScanners()) cout << right << setw(10) << s.name;
+    cout << "\n";
+
+    for(const string& path : files) {
+        ifstream in(path, ios::binary);
+        if(!in) continue;
+        stringstream ss;
+        ss << in.rdbuf();
+        measure(fs::path(path).filename().string(), ss.str());
+    }
+
+    const size_t size = 256 << 20;
+    measure("256 MB, 40 B lines", synthetic(size, 40, "\n"));
+    measure("256 MB, 40 B CRLF lines", synthetic(size, 40, "\r\n"));
+    measure("256 MB, 4 KB lines", synthetic(size, 4096, "\n"));
+    return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Text storage used by the editor. The piece table is the default; configure
+// with -DTEDIT_ROPE=ON to build against the B-tree rope instead. Both expose the
+// same line/offset interface.
+#ifdef TEDIT_USE_ROPE
+#include "rope.h"
+using TextBuffer = Rope;
+#else
+#include "piecetable.h"
+using TextBuffer = PieceTable;
+#endif
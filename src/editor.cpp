@@ -1,22 +1,133 @@
 #include "editor.h"
+#include "unicode.h"
 #include <unistd.h>
-#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <cstdlib>
 #include <fstream>
-#include <sstream>
 #include <regex>
 #include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <tuple>
+#include <utility>
 using namespace std;
 
+// The final line break of a file is implied by the editor and written back on save
+static size_t trimFinalBreak(const char* data, size_t size) {
+    if(size > 0 && data[size - 1] == '\n') {
+        size--;
+        if(size > 0 && data[size - 1] == '\r') size--;
+    }
+    return size;
+}
+
+static string lineBreakOf(const char* data, size_t size) {
+    const char* nl = (const char*)memchr(data, '\n', min(size, (size_t)1 << 16));
+    return (nl && nl > data && nl[-1] == '\r') ? "\r\n" : "\n";
+}
+
+// A key that types a character
+static bool isTextKey(int key) {
+    return key >= 0 && ((key & TEXT_CHAR) || (key < 128 && isprint(key)));
+}
+
+static const uint8_t STATUS_STYLE = HL_TYPES; // after the highlight types
+static const auto FRAME_INTERVAL = chrono::milliseconds(16); // at most ~60 frames a second
+static const auto MAX_FRAME_DELAY = chrono::milliseconds(100); // drawn at least this often under a flood of input
+static const int OVERVIEW_COLS = 2; // the viewport and change markers, then the row summary
+static const auto SUMMARY_BUDGET = chrono::milliseconds(8); // of each frame, for summarizing rows for the overview
+
+static const auto STATUS_TIMEOUT = chrono::seconds(3); // how long a status message stays up
+static const int LOADING_INTERVAL = 100; // ms between redraws that follow loading progress
+static const int PASTE_TIMEOUT = 500; // ms to wait for more of a paste before taking it as it is
+static const auto REPEAT_GAP = chrono::milliseconds(120); // the same key again within this is a held key
+static const auto REPEAT_SPACING = chrono::milliseconds(15); // and at least this long after it: key repeat is never faster
+static const int REPEAT_RAMP = 16;    // held arrows move twice as far after every this many repeats
+static const int MAX_REPEAT_STEP = 8; // rows
+
 Editor::Editor() : cursorX(0), cursorY(0) {
-    rows.push_back("");
+    buffer.setWakeup(events.wakeFd()); // lines indexed in the background draw a frame
+    updateWindowSize();
+    showStats = getenv("TEDIT_STATS") != nullptr;
+    // Scroll regions with SU/SD are supported by everything but the oldest terminals
+    const char* term = getenv("TERM");
+    screen.useScrollRegions(term && *term && strcmp(term, "dumb") != 0 && strncmp(term, "vt52", 4) != 0 && strncmp(term, "vt100", 5) != 0);
+    // Ask whether the terminal knows synchronized output (mode 2026); readKey()
+    // picks up the answer, and terminals that don't know the query ignore it
+    frame.append("\x1b[?2026$p");
+    frame.append("\x1b[?2004h"); // pasted text comes bracketed, to be inserted in one go
+    applyTheme();
+}
+
+// Handles the next key, then every key that is already waiting or arrives
+// before the next frame is due, so a burst of input costs one frame
+bool Editor::processInput() {
+    if(!processKeypress()) return false;
+    auto start = chrono::steady_clock::now();
+    while(true) {
+        auto now = chrono::steady_clock::now();
+        if(now - start >= MAX_FRAME_DELAY) break;
+        int wait = (int)max<long>(0, chrono::duration_cast<chrono::milliseconds>(lastFrame + FRAME_INTERVAL - now).count());
+        if(!keys.pending() && !waitForInput(wait)) break;
+        if(!processKeypress()) return false;
+    }
+    return true;
+}
+
+// True once a key can be read; false on timeout or when anything else calls
+// for a new frame (a resize, a timer, lines indexed in the background)
+bool Editor::waitForInput(int timeoutMs) {
+    EventLoop::Event e = events.wait(timeoutMs);
+    if(e == EventLoop::TERMINATE) terminated = true;
+    return e == EventLoop::INPUT;
+}
+
+// Milliseconds until a frame is due without any input, -1 if none is
+int Editor::nextFrameDue() {
+    int due = -1;
+    auto soonest = [&](int ms) { if(due < 0 || ms < due) due = max(ms, 0); };
+    if(!statusMessage.empty()) {
+        auto left = statusTime + STATUS_TIMEOUT - chrono::steady_clock::now();
+        soonest((int)chrono::duration_cast<chrono::milliseconds>(left).count() + 1);
+    }
+    if(!buffer.indexed()) soonest(LOADING_INTERVAL); // bytes read so far have no wakeup of their own
+    if(showOverview && overview.pending()) soonest((int)FRAME_INTERVAL.count());
+    return due;
+}
+
+// Takes the terminal size, once at startup and on every frame after
+void Editor::updateWindowSize() {
+    struct winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0 || ws.ws_col == 0) return; // keep the last known size
+    screenRows = max((int)ws.ws_row, 2); // at least one text row above the status bar
+    screenCols = ws.ws_col;
 }
 
 bool Editor::processKeypress() {
     int key = readKey();
+    if(terminated) key = 17; // SIGTERM quits like Ctrl-Q, without saving
+    if(key == -1) { // no input yet; something else wants a frame
+        summarizeRows(); // and use the time to fill in the overview
+        return true;
+    }
+    // Timed by when the keys came in, not when they are handled: keys that
+    // arrived together (typeahead, a script, a connection catching up) aren't held
+    auto arrived = keys.arrived();
+    keyHeld = key == lastKey && arrived - lastKeyTime >= REPEAT_SPACING && arrived - lastKeyTime < REPEAT_GAP;
+    if(keyHeld) keyRepeats++;
+    else if(key != lastKey || arrived - lastKeyTime >= REPEAT_GAP) keyRepeats = 0;
+    lastKey = key;
+    lastKeyTime = arrived;
+    followEnd = false; // any key ends following Ctrl-End
+    auto shownSince = statusTime;
 
     switch(key) {
         case 17: // Ctrl-Q
-            cout << "\x1b[2J\x1b[H"; // Clear screen
+            frame.append("\x1b[?2004l\x1b[m\x1b[2J\x1b[H"); // Plain paste again, reset colors and clear screen
+            frame.flush();
             return false;
             break;
         case 19: // Ctrl-S
@@ -28,6 +139,18 @@ bool Editor::processKeypress() {
         case 18: // Ctrl-R
             renameFile();
             break;
+        case 7: // Ctrl-G
+            goToLine();
+            break;
+        case 2: // Ctrl-B
+            goToOffset();
+            break;
+        case 5: // Ctrl-E
+            toggleSoftWrap();
+            break;
+        case 20: // Ctrl-T
+            toggleOverview();
+            break;
         case '\t': { // Tab Key => Insert 4 spaces as one action
             Action a;
             a.type = ActionType::InsertText;
@@ -39,15 +162,14 @@ bool Editor::processKeypress() {
             break;
         }
         case '\r': { // Enter Key
-            // Split line at cursor; store suffix and indent in action
+            // Split line at cursor; store line break and indent in action
             Action a;
             a.type = ActionType::SplitLine;
             a.beforeX = cursorX; a.beforeY = cursorY;
             a.y = cursorY; a.x = cursorX;
-            string suffix = "";
-            if(cursorX < (int)rows[cursorY].size()) suffix = rows[cursorY].substr(cursorX);
-            a.text = suffix; // original suffix
-            a.aux = string(getIndentLevel(rows[cursorY]), ' '); // indent to apply on new line
+            a.text = eol; // line break to insert
+            string scratch;
+            a.aux = string(getIndentLevel(buffer.lineView(cursorY, scratch)), ' '); // indent to apply on new line
             applyForward(a);
             a.afterX = cursorX; a.afterY = cursorY;
             pushAction(a);
@@ -55,12 +177,13 @@ bool Editor::processKeypress() {
         } case 127: // Backspace
         case 8:   // Ctrl-H
             if(cursorX > 0) {
-                // Delete previous character as one action
+                // Delete previous character (with its combining marks) as one action
+                const WidthMap& w = widthsOf(cursorY, cursorX, 0);
                 Action a;
                 a.type = ActionType::DeleteRange;
                 a.beforeX = cursorX; a.beforeY = cursorY;
-                a.y = cursorY; a.x = cursorX - 1;
-                a.text = string(1, rows[cursorY][cursorX - 1]);
+                a.y = cursorY; a.x = w.glyph(w.glyphAt(cursorX - 1)).byte;
+                a.text = buffer.substr(buffer.lineStart(cursorY) + a.x, cursorX - a.x);
                 applyForward(a);
                 a.afterX = cursorX; a.afterY = cursorY;
                 pushAction(a);
@@ -70,31 +193,102 @@ bool Editor::processKeypress() {
                 a.type = ActionType::JoinLine;
                 a.beforeX = cursorX; a.beforeY = cursorY;
                 a.y = cursorY; // current line index to be joined into y-1
-                a.x = rows[cursorY - 1].size(); // join point in previous line
-                a.text = rows[cursorY]; // content of current line
+                a.x = buffer.lineLength(cursorY - 1); // join point in previous line
+                size_t joinAt = buffer.lineStart(cursorY - 1) + a.x;
+                a.text = buffer.substr(joinAt, buffer.lineStart(cursorY) - joinAt); // line break removed
+                applyForward(a);
+                a.afterX = cursorX; a.afterY = cursorY;
+                pushAction(a);
+            }
+            break;
+        case DEL_KEY: // the character under the cursor, or the line break after it
+            if(cursorX < buffer.lineLength(cursorY)) {
+                const WidthMap& w = widthsOf(cursorY, cursorX + 1, 0);
+                Action a;
+                a.type = ActionType::DeleteRange;
+                a.beforeX = cursorX; a.beforeY = cursorY;
+                a.y = cursorY; a.x = cursorX;
+                int end = w.glyph(w.glyphAt(cursorX) + 1).byte;
+                a.text = buffer.substr(buffer.lineStart(cursorY) + a.x, end - a.x);
+                applyForward(a);
+                a.afterX = cursorX; a.afterY = cursorY;
+                pushAction(a);
+            } else if(cursorY < buffer.lineCount() - 1) {
+                // Join the next line onto this one
+                Action a;
+                a.type = ActionType::JoinLine;
+                a.beforeX = cursorX; a.beforeY = cursorY;
+                a.y = cursorY + 1;
+                a.x = cursorX;
+                size_t joinAt = buffer.lineStart(cursorY) + a.x;
+                a.text = buffer.substr(joinAt, buffer.lineStart(cursorY + 1) - joinAt);
                 applyForward(a);
                 a.afterX = cursorX; a.afterY = cursorY;
                 pushAction(a);
             }
             break;
+        case PASTE_START: { // Bracketed paste: inserted as is (no auto-indent) as one action
+            Action a;
+            a.type = ActionType::InsertText;
+            a.beforeX = cursorX; a.beforeY = cursorY;
+            a.y = cursorY; a.x = cursorX; a.text = readPaste();
+            if(a.text.empty()) break;
+            applyForward(a);
+            a.afterX = cursorX; a.afterY = cursorY;
+            pushAction(a);
+            break;
+        }
         case ARROW_UP:
-            if(cursorY > 0) cursorY--;
-            if(cursorX > (int)rows[cursorY].size()) cursorX = rows[cursorY].size();
+        case ARROW_DOWN: { // stay in the same screen column, faster the longer the key is held
+            int step = keyHeld ? min(1 << min(keyRepeats / REPEAT_RAMP, 8), MAX_REPEAT_STEP) : 1;
+            if(softWrap) {
+                moveVisual(key == ARROW_UP ? -step : step);
+                break;
+            }
+            int col = cursorColumn();
+            if(key == ARROW_UP) cursorY = max(cursorY - step, 0);
+            else cursorY = max(min(cursorY + step, buffer.lineCount() - 1), cursorY);
+            cursorX = byteAtColumn(cursorY, col);
+            break;
+        }
+        case PAGE_UP:
+        case PAGE_DOWN:
+            jumpRows(key == PAGE_UP ? -(screenRows - 1) : screenRows - 1);
+            break;
+        case 21: // Ctrl-U
+        case 4:  // Ctrl-D
+            jumpRows(key == 21 ? -(screenRows - 1) / 2 : (screenRows - 1) / 2);
+            break;
+        case HOME_KEY:
+            cursorX = 0;
+            break;
+        case END_KEY:
+            cursorX = buffer.lineLength(cursorY);
             break;
-        case ARROW_DOWN:
-            if(cursorY < (int)rows.size() - 1) cursorY++;
-            if(cursorX > (int)rows[cursorY].size()) cursorX = rows[cursorY].size();
+        case HOME_KEY | KEY_CTRL: // the start of the file
+            cursorY = cursorX = 0;
+            break;
+        case END_KEY | KEY_CTRL: // the end of the file, as far as it is indexed
+            cursorY = buffer.lineCount() - 1;
+            cursorX = buffer.lineLength(cursorY);
+            followEnd = !buffer.indexed(); // and further as more lines are indexed
             break;
         case ARROW_LEFT:
-            if(cursorX > 0) cursorX--;
+            if(cursorX > 0) {
+                const WidthMap& w = widthsOf(cursorY, cursorX, 0);
+                cursorX = w.glyph(w.glyphAt(cursorX - 1)).byte;
+            }
             else if(cursorY > 0) {
                 cursorY--;
-                cursorX = rows[cursorY].size();
+                cursorX = buffer.lineLength(cursorY);
             }
             break;
         case ARROW_RIGHT:
-            if(cursorX < (int)rows[cursorY].size()) cursorX++;
-            else if(cursorY < (int)rows.size() - 1) {
+            if(cursorX < buffer.lineLength(cursorY)) {
+                const WidthMap& w = widthsOf(cursorY, cursorX + 1, 0);
+                cursorX = w.glyph(w.glyphAt(cursorX) + 1).byte;
+            }
+            else if(cursorY < buffer.lineCount() - 1) {
                 cursorY++;
                 cursorX = 0;
             }
@@ -106,11 +300,18 @@ bool Editor::processKeypress() {
             redo();
             break;
         default:
-            if(isprint(key)) {
+            if(isTextKey(key)) {
+                // Characters typed ahead and already read go in with this one, as one action
                 Action a;
                 a.type = ActionType::InsertText;
                 a.beforeX = cursorX; a.beforeY = cursorY;
-                a.y = cursorY; a.x = cursorX; a.text = string(1, (char)key);
+                a.y = cursorY; a.x = cursorX;
+                while(true) {
+                    if(key & TEXT_CHAR) appendUtf8(a.text, key & ~TEXT_CHAR);
+                    else a.text += (char)key;
+                    if(!isTextKey(keys.peek())) break;
+                    key = keys.next();
+                }
                 applyForward(a);
                 a.afterX = cursorX; a.afterY = cursorY;
                 pushAction(a);
@@ -118,33 +319,86 @@ bool Editor::processKeypress() {
             break;
     }
 
-    if(key != 19 && key != 23 && key != 18 && key != 26 && key != 25) setStatusMessage("");
+    if(statusTime == shownSince) setStatusMessage(""); // a key clears the last message unless it set its own
     return true;
 }
 
 void Editor::insertChar(char ch) {
-    if(cursorY >= (int)rows.size()) return;
-    if(cursorX > (int)rows[cursorY].size()) cursorX = rows[cursorY].size();
-    rows[cursorY].insert(rows[cursorY].begin() + cursorX, ch);
+    if(cursorY >= buffer.lineCount()) return;
+    if(cursorX > buffer.lineLength(cursorY)) cursorX = buffer.lineLength(cursorY);
+    buffer.insert(buffer.lineStart(cursorY) + cursorX, string(1, ch));
+    rowsChanged(cursorY, 1, 1);
     cursorX++;
 }
 void Editor::insertTextAt(int y, int x, const string& s) {
-    if(y < 0) return;
-    if(y >= (int)rows.size()) rows.resize(y + 1);
-    string& line = rows[y];
+    if(y < 0 || y >= buffer.lineCount()) return;
     if(x < 0) x = 0;
-    if(x > (int)line.size()) x = line.size();
-    line.insert(x, s);
+    if(x > buffer.lineLength(y)) x = buffer.lineLength(y);
+    buffer.insert(buffer.lineStart(y) + x, s);
+    rowsChanged(y, 1, 1 + (int)count(s.begin(), s.end(), '\n'));
 }
 
+// len may run past the end of the line; the range then includes line breaks
 void Editor::deleteRangeAt(int y, int x, int len) {
-    if(y < 0 || y >= (int)rows.size()) return;
-    string& line = rows[y];
+    if(y < 0 || y >= buffer.lineCount()) return;
     if(x < 0) x = 0;
-    if(x > (int)line.size()) x = line.size();
+    if(x > buffer.lineLength(y)) x = buffer.lineLength(y);
     if(len < 0) len = 0;
-    if(x + len > (int)line.size()) len = line.size() - x;
-    line.erase(x, len);
+    size_t start = buffer.lineStart(y) + x;
+    int lines = buffer.lineOf(min(start + len, buffer.size())) - y + 1; // rows the range touches
+    buffer.erase(start, len);
+    rowsChanged(y, lines, 1);
+}
+
+// Rows [y, y + oldCount) were replaced by [y, y + newCount), by an edit or
+// by loading. The highlight cache keeps the rows that only moved, and the rows
+// on screen from y down (or just the changed ones, if nothing moved) are drawn
+// again.
+void Editor::rowsChanged(int y, int oldCount, int newCount, bool edited) {
+    int moved = newCount - oldCount;
+    int first = y - cacheFirst, cached = rowCache.size();
+    if(first < 0 && moved != 0) rowCache.clear(); // the whole window moved
+    else {
+        if(moved < 0 && first < cached) rowCache.erase(rowCache.begin() + first + 1, rowCache.begin() + min(first + 1 - moved, cached));
+        else if(moved > 0 && first < cached) rowCache.insert(rowCache.begin() + first + 1, moved, CachedRow());
+        for(int i = max(first, 0); i < min(first + newCount, (int)rowCache.size()); i++) {
+            rowCache[i].limit = 0;
+            rowCache[i].widths.clear();
+            rowCache[i].laidOut = false;
+        }
+    }
+    otherY = -1;
+
+    if(showOverview && y + oldCount <= overview.rows()) {
+        vector<uint32_t> rows(newCount);
+        for(int i = 0; i < newCount; i++) rows[i] = Overview::row(buffer.lineLength(y + i), edited);
+        overview.splice(y, oldCount, rows);
+    }
+
+    if(softWrap) {
+        // The new rows are estimated until they are laid out; a row that
+        // wraps differently moves everything below it on screen
+        if(y + oldCount <= wrapIndex.rows()) {
+            vector<uint32_t> counts(newCount);
+            for(int i = 0; i < newCount; i++) counts[i] = estimateLines(y + i);
+            wrapIndex.splice(y, oldCount, counts);
+        }
+        else wrapCols = 0;
+        rowDirty.assign(rowDirty.size(), 1);
+        return;
+    }
+
+    int from = max(y - drawnRowOffset, 0);
+    int to = moved == 0 ? y - drawnRowOffset + oldCount : (int)rowDirty.size();
+    for(int i = from; i < min(to, (int)rowDirty.size()); i++) rowDirty[i] = 1;
+}
+
+// Highlighting rules changed: everything on screen is highlighted and drawn again
+void Editor::invalidateRows() {
+    rowCache.clear();
+    rowDirty.clear();
+    otherY = -1;
+    overview.restart();
 }
 
 void Editor::pushAction(const Action& a) {
@@ -156,8 +410,9 @@ void Editor::applyForward(const Action& a) {
     switch(a.type) {
         case ActionType::InsertText: {
             insertTextAt(a.y, a.x, a.text);
-            cursorY = a.y;
-            cursorX = a.x + (int)a.text.size();
+            size_t lastBreak = a.text.rfind('\n');
+            cursorY = a.y + (int)count(a.text.begin(), a.text.end(), '\n');
+            cursorX = lastBreak == string::npos ? a.x + (int)a.text.size() : (int)(a.text.size() - lastBreak - 1);
             break;
         }
         case ActionType::DeleteRange: {
@@ -167,19 +422,16 @@ void Editor::applyForward(const Action& a) {
             break;
         }
         case ActionType::SplitLine: {
-            // rows[y] = prefix; insert rows[y+1] = indent + suffix
-            string prefix = rows[a.y].substr(0, a.x);
-            rows[a.y] = prefix;
-            rows.insert(rows.begin() + a.y + 1, a.aux + a.text);
+            // insert line break + indent at the split point
+            insertTextAt(a.y, a.x, a.text + a.aux);
             cursorY = a.y + 1;
             cursorX = (int)a.aux.size();
             break;
         }
         case ActionType::JoinLine: {
-            // rows[y-1] += rows[y]; remove rows[y]
-            if(a.y - 1 >= 0 && a.y < (int)rows.size()) {
-                rows[a.y - 1] += rows[a.y];
-                rows.erase(rows.begin() + a.y);
+            // remove the line break between rows y-1 and y
+            if(a.y - 1 >= 0 && a.y < buffer.lineCount()) {
+                deleteRangeAt(a.y - 1, a.x, (int)a.text.size());
                 cursorY = a.y - 1;
                 cursorX = a.x;
             }
@@ -205,10 +457,9 @@ void Editor::applyInverse(const Action& a) {
             break;
         }
         case ActionType::SplitLine: {
-            // inverse merges back original suffix and removes inserted line
-            if(a.y + 1 < (int)rows.size()) {
-                rows[a.y] += a.text;
-                rows.erase(rows.begin() + a.y + 1);
+            // inverse removes the inserted line break and indent
+            if(a.y + 1 < buffer.lineCount()) {
+                deleteRangeAt(a.y, a.x, (int)(a.text.size() + a.aux.size()));
                 cursorY = a.beforeY;
                 cursorX = a.beforeX;
             }
@@ -216,11 +467,8 @@ void Editor::applyInverse(const Action& a) {
         }
         case ActionType::JoinLine: {
             // inverse splits line back
-            if(a.y - 1 >= 0 && a.y - 1 < (int)rows.size()) {
-                string& prev = rows[a.y - 1];
-                string suffix = prev.substr(a.x);
-                prev.erase(a.x);
-                rows.insert(rows.begin() + a.y, suffix);
+            if(a.y - 1 >= 0 && a.y - 1 < buffer.lineCount()) {
+                insertTextAt(a.y - 1, a.x, a.text);
                 cursorY = a.beforeY;
                 cursorX = a.beforeX;
             }
@@ -243,7 +491,7 @@ void Editor::redo() {
     undoStack.push_back(a);
 }
 
-int Editor::getIndentLevel(const string& line) {
+int Editor::getIndentLevel(string_view line) {
     int indent = 0;
     for(char ch : line) {
         if(ch == ' ') indent++;
@@ -254,83 +502,559 @@ int Editor::getIndentLevel(const string& line) {
 }
 
 void Editor::refreshScreen() {
+    updateWindowSize();
+    int lines = buffer.lineCount();
+    size_t bytes = buffer.size();
+    buffer.pollIndex();
+    buffer.indexLines(max(cursorY, rowOffset) + 2 * screenRows); // visible rows plus one page ahead
+    if(buffer.size() != bytes) rowsChanged(lines - 1, 1, buffer.lineCount() - lines + 1, false); // lines arrived at the end
+    if(followEnd) {
+        cursorY = buffer.lineCount() - 1;
+        cursorX = buffer.lineLength(cursorY);
+        followEnd = !buffer.indexed();
+    }
+    detectLineBreak();
     scroll();
-    cout << "\x1b[2J\x1b[H"; // Clear screen and move cursor to top-left
+    screen.resize(screenRows, screenCols);
     drawRows();
-
-    cout << "\x1b[" << (cursorY - rowOffset + 1) << ";" << (cursorX - colOffset + 1) << "H"; // Move cursor to (cursorY, cursorX)
-    cout << "\x1b[?25h"; // Show cursor
-    cout.flush();
+    int y, x;
+    cursorOnScreen(y, x);
+    screen.present(frame, palette, y, x); // only what changed since the last frame
+    frame.flush();
+    lastFrame = chrono::steady_clock::now();
+    events.setTimer(nextFrameDue());
 }
 
 void Editor::drawRows() {
-    drawContentRows(screenRows);
+    // The status bar always takes the last row, also for files taller than the screen
+    drawContentRows(screenRows - 1);
+    drawOverview(screenRows - 1);
+    drawStatusBar();
 }
 
+// Only rows marked dirty by edits, scrolling or loading are drawn again, and
+// only rows whose text changed are highlighted again; the rest of the screen
+// keeps the cells drawn in earlier frames.
 void Editor::drawContentRows(int numRows) {
+    if(softWrap) {
+        drawWrappedRows(numRows);
+        return;
+    }
+    slideRowCache(numRows);
+
+    // A short scroll moves the drawn rows (and their dirty flags) along;
+    // only the rows scrolled into view are drawn
+    int moved = rowOffset - drawnRowOffset;
+    if(moved != 0 && abs(moved) < numRows && (int)rowDirty.size() == numRows && colOffset == drawnColOffset && textCols() == drawnCols) {
+        shiftDrawnRows(numRows, moved);
+        drawnRowOffset = rowOffset;
+    }
+
+    // A change of height keeps the rows that stay on screen; the rest is new
+    rowDirty.resize(numRows, 1);
+
+    // Anything else moves every cell on screen
+    if(rowOffset != drawnRowOffset || colOffset != drawnColOffset || textCols() != drawnCols) {
+        rowDirty.assign(numRows, 1);
+        drawnRowOffset = rowOffset;
+        drawnColOffset = colOffset;
+        drawnCols = textCols();
+    }
+
+    string scratch; // only used for lines that span pieces
     for(int y = 0; y < numRows; y++) {
+        if(!rowDirty[y]) continue;
+        rowDirty[y] = 0;
+        screen.clearRow(y);
+
         int fileRow = y + rowOffset;
-        if(fileRow >= (int)rows.size()) {
-            if(y == numRows - 1 && numRows == screenRows) drawStatusBar();
-            else {
-                cout << "~";
-                if(y < numRows - 1) cout << "\r\n";
-            }
+        if(fileRow >= buffer.lineCount()) {
+            screen.put(y, 0, '~', 0);
         }
         else {
-            Syntax::updateSyntax(rows, hl, fileRow);
-            string& line = rows[fileRow];
-
-            int len = line.size() > colOffset ? line.size() - colOffset : 0;
-            int drawLen = len < screenCols ? len : screenCols;
-
-            for(int i = 0; i < drawLen; i++) {
-                int hlType = 0;
-                if((int)hl[fileRow].size() > i + colOffset) hlType = hl[fileRow][i + colOffset];
-                switch(hlType) {
-                    case 0: cout << "\x1b[39m"; break;
-                    case 1: cout << "\x1b[" + Syntax::currentTheme.colors["keyword"] + "m"; break;
-                    case 2: cout << "\x1b[" + Syntax::currentTheme.colors["number"] + "m"; break;
-                    case 3: cout << "\x1b[" + Syntax::currentTheme.colors["string"] + "m"; break;
-                    case 4: cout << "\x1b[" + Syntax::currentTheme.colors["comment"] + "m"; break;
-                }
-                cout << line[i + colOffset];
+            // Only the glyphs between colOffset and the right edge are drawn,
+            // and highlighting never needs anything past them (plus room to see
+            // where a keyword at the edge ends)
+            CachedRow& row = rowCache[y];
+            const WidthMap& w = widthsOf(fileRow, 0, colOffset + textCols());
+            size_t first = w.glyphAtColumn(colOffset);
+            size_t last = min(w.glyphAtColumn(colOffset + textCols() - 1) + 1, w.glyphs());
+            string_view line = highlightRow(fileRow, row, w.glyph(last).byte + 64, scratch);
+            drawGlyphs(y, row.types, line, w, first, last, colOffset);
+        }
+    }
+}
+
+// Soft wrap: screen rows are the visual lines from rowSub of row rowOffset on.
+// The rows are laid out as they are drawn, so the wrap index is exact for
+// everything on screen.
+void Editor::drawWrappedRows(int numRows) {
+    slideRowCache(numRows);
+
+    // Scrolling by fewer visual lines than the screen has moves the drawn rows
+    // along; the rows between the old and the new top are laid out first so
+    // the distance between them is exact
+    if((int)rowDirty.size() == numRows && textCols() == drawnCols && (rowOffset != drawnRowOffset || rowSub != drawnRowSub)
+        && abs(rowOffset - drawnRowOffset) < numRows) {
+        for(int y = min(rowOffset, drawnRowOffset); y < max(rowOffset, drawnRowOffset); y++) wrapsOf(y);
+        long moved = (long)visualTop() - (long)(wrapIndex.lineOf(drawnRowOffset) + drawnRowSub);
+        if(moved != 0 && labs(moved) < numRows) {
+            shiftDrawnRows(numRows, (int)moved);
+            drawnRowOffset = rowOffset;
+            drawnRowSub = rowSub;
+        }
+    }
+
+    rowDirty.resize(numRows, 1);
+    if(rowOffset != drawnRowOffset || rowSub != drawnRowSub || textCols() != drawnCols) {
+        rowDirty.assign(numRows, 1);
+        drawnRowOffset = rowOffset;
+        drawnRowSub = rowSub;
+        drawnCols = textCols();
+    }
+
+    string scratch;
+    int y = 0;
+    for(int fileRow = rowOffset, sub = rowSub; y < numRows; fileRow++, sub = 0) {
+        if(fileRow >= buffer.lineCount()) {
+            if(rowDirty[y]) {
+                rowDirty[y] = 0;
+                screen.clearRow(y);
+                screen.put(y, 0, '~', 0);
             }
+            y++;
+            continue;
+        }
+
+        // The visual lines of this row on screen, highlighted as far as the last of them
+        const vector<int>& wraps = wrapsOf(fileRow);
+        int shown = min((int)wraps.size() + 1 - sub, numRows - y);
+        if(find(rowDirty.begin() + y, rowDirty.begin() + y + shown, 1) == rowDirty.begin() + y + shown) {
+            y += shown;
+            continue;
+        }
+        CachedRow& row = rowCache[fileRow - cacheFirst];
+        const WidthMap& w = row.widths;
+        size_t end = sub + shown <= (int)wraps.size() ? wraps[sub + shown - 1] : w.glyphs();
+        string_view line = highlightRow(fileRow, row, w.glyph(end).byte + 64, scratch);
+        for(int k = sub; k < sub + shown; k++, y++) {
+            if(!rowDirty[y]) continue;
+            rowDirty[y] = 0;
+            screen.clearRow(y);
+            size_t first = k == 0 ? 0 : wraps[k - 1];
+            size_t last = k < (int)wraps.size() ? wraps[k] : w.glyphs();
+            drawGlyphs(y, row.types, line, w, first, last, w.glyph(first).col);
+        }
+    }
+}
 
-            cout << "\x1b[39m"; // Reset to normal color
-            cout << "\x1b[K"; // Clear line after content
-            if(y < numRows - 1) cout << "\r\n";
+// Slides the cache window to the rows on screen; rows scrolled in start empty
+void Editor::slideRowCache(int numRows) {
+    if(rowCache.empty()) cacheFirst = rowOffset;
+    int shift = rowOffset - cacheFirst;
+    if(shift > 0) rowCache.erase(rowCache.begin(), rowCache.begin() + min(shift, (int)rowCache.size()));
+    else if(shift < 0) rowCache.insert(rowCache.begin(), min(-shift, numRows), CachedRow());
+    cacheFirst = rowOffset;
+    rowCache.resize(numRows);
+}
+
+// Scrolls the cells on screen (and their dirty flags) by moved rows; the rows
+// scrolled in are dirty
+void Editor::shiftDrawnRows(int numRows, int moved) {
+    screen.scroll(0, numRows, moved);
+    if(moved > 0) {
+        rowDirty.erase(rowDirty.begin(), rowDirty.begin() + moved);
+        rowDirty.insert(rowDirty.end(), moved, 1);
+    } else {
+        rowDirty.erase(rowDirty.end() + moved, rowDirty.end());
+        rowDirty.insert(rowDirty.begin(), -moved, 1);
+    }
+}
+
+// Draws glyphs [first, last) of a line on screen row y; column `left` of the
+// line goes at the left edge of the screen
+void Editor::drawGlyphs(int y, const vector<uint8_t>& types, string_view line, const WidthMap& w, size_t first, size_t last, int left) {
+    for(size_t g = first; g < last; g++) {
+        WidthMap::Glyph at = w.glyph(g), end = w.glyph(g + 1);
+        int x = at.col - left, width = end.col - at.col;
+        uint8_t hlType = (size_t)at.byte < types.size() ? types[at.byte] : (uint8_t)HL_NORMAL;
+        unsigned char ch = line[at.byte];
+        if(x < 0 || ch == '\t') { // tabs, and a wide glyph cut by the left edge, are blanks
+            for(int i = max(x, 0); i < min(x + width, textCols()); i++) screen.put(y, i, ' ', hlType);
+        }
+        // control characters would move the terminal's cursor
+        else if(ch < 32 || ch == 127) screen.put(y, x, '?', hlType);
+        else if(x + width > textCols()) screen.put(y, x, ' ', hlType); // a wide glyph cut by the right edge
+        else if(ch < 0x80 && end.byte == at.byte + 1) screen.put(y, x, ch, hlType);
+        else {
+            string_view glyph = line.substr(at.byte, end.byte - at.byte);
+            size_t i = 0;
+            uint32_t cp = decodeUtf8(glyph.data(), glyph.size(), i);
+            if(cp >= 0x80 && cp < 0xA0) screen.put(y, x, '?', hlType); // C1 controls
+            else if(cp == REPLACEMENT_CHAR) screen.putGlyph(y, x, "\xEF\xBF\xBD", 1, hlType); // also for bytes that aren't UTF-8
+            else if(codepointWidth(cp) == 0) screen.putGlyph(y, x, " " + string(glyph), 1, hlType); // a mark with nothing to go on
+            else screen.putGlyph(y, x, glyph, width, hlType);
         }
     }
 }
 
+// The cache entry of row y: its place among the rows on screen, or the one
+// entry kept for a row elsewhere (emptied when another row takes it)
+Editor::CachedRow& Editor::cachedRow(int y) {
+    int i = y - cacheFirst;
+    if(i >= 0 && i < (int)rowCache.size()) return rowCache[i];
+    if(y != otherY) {
+        otherRow = CachedRow();
+        otherY = y;
+    }
+    return otherRow;
+}
+
+// Line y up to limit bytes, with the row's highlighting brought that far
+string_view Editor::highlightRow(int y, CachedRow& row, size_t limit, string& scratch) {
+    string_view line = buffer.lineView(y, scratch, limit);
+    bool whole = row.limit > 0 && row.types.size() < row.limit; // the whole line was seen
+    if(row.limit < limit && !whole) {
+        Syntax::updateSyntax(line, row.types);
+        row.limit = limit;
+    }
+    return line;
+}
+
+// The width map of line y, covering at least byte x and column col (or the
+// whole line if it is shorter)
+const WidthMap& Editor::widthsOf(int y, size_t x, int col) {
+    WidthMap& w = cachedRow(y).widths;
+    if(y >= buffer.lineCount()) {
+        if(!w.complete()) w.extend("", 0, true);
+        return w;
+    }
+    string scratch;
+    while(!w.complete() && (w.bytes() < x || w.width() < col)) {
+        size_t want = max({x, w.bytes() * 2, (size_t)max(col, 0), (size_t)256});
+        string_view line = buffer.lineView(y, scratch, want + 64);
+        w.extend(line, want, line.size() < want + 64);
+    }
+    return w;
+}
+
+// Where the visual lines of row y after the first start (see wrapLine), with
+// the whole row laid out at the screen width. The wrap index takes the count.
+const vector<int>& Editor::wrapsOf(int y) {
+    CachedRow& row = cachedRow(y);
+    if(row.laidOut) return row.wraps;
+    row.wraps.clear();
+    if(y < buffer.lineCount()) {
+        const WidthMap& w = widthsOf(y, buffer.lineLength(y), 0);
+        string scratch;
+        wrapLine(w, buffer.lineView(y, scratch), textCols(), row.wraps);
+        if(y < wrapIndex.rows()) wrapIndex.set(y, row.wraps.size() + 1);
+    }
+    row.laidOut = true;
+    return row.wraps;
+}
+
+int Editor::cursorColumn() {
+    return widthsOf(cursorY, cursorX, 0).column(cursorX);
+}
+
+// The visual line of row cursorY the cursor is on (soft wrap)
+int Editor::cursorSub() {
+    const vector<int>& wraps = wrapsOf(cursorY);
+    int g = widthsOf(cursorY, cursorX, 0).glyphAt(cursorX);
+    return upper_bound(wraps.begin(), wraps.end(), g) - wraps.begin();
+}
+
+// Where on line y the glyph covering column col starts (the line end past it)
+int Editor::byteAtColumn(int y, int col) {
+    const WidthMap& w = widthsOf(y, 0, col + 1);
+    return w.glyph(w.glyphAtColumn(col)).byte;
+}
+
 int Editor::readKey() {
-    char ch;
-    if(read(STDIN_FILENO, &ch, 1) == -1) return -1;
-    
-    if(ch == '\x1b') {
-        char seq[3];
-        if(read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if(read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-
-        if(seq[0] == '[') {
-            switch(seq[1]) {
-                case 'A': return ARROW_UP;
-                case 'B': return ARROW_DOWN;
-                case 'C': return ARROW_RIGHT;
-                case 'D': return ARROW_LEFT;
-            }
+    // Anything but a key (a resize, the timer set after the last frame, lines
+    // indexed in the background) comes back as -1 to draw a frame
+    while(!terminated) {
+        int key = keys.next();
+        if(key == KEY_REPORT) {
+            // the terminal's answer to the synchronized output query
+            const string& r = keys.report();
+            if(r.compare(0, 6, "?2026;") == 0 && r.size() > 6) screen.useSynchronizedOutput(r[6] == '1' || r[6] == '2');
+            continue;
+        }
+        if(key != -1) return key;
+
+        // An incomplete sequence waits a moment for the rest (an ESC alone is the Escape key)
+        int timeout = keys.timeLeft();
+        if(timeout == 0) return keys.flush();
+        if(!waitForInput(timeout)) {
+            if(keys.timeLeft() == 0) continue;
+            return -1;
+        }
+        if(!keys.fill(STDIN_FILENO)) terminated = true; // the terminal is gone
+    }
+    return -1;
+}
+
+// The text of a bracketed paste, with its line breaks (sent as CR) in the
+// file's style. If the end of the paste doesn't come, what arrived is taken.
+string Editor::readPaste() {
+    string raw;
+    auto last = chrono::steady_clock::now();
+    while(!terminated && !keys.paste(raw)) {
+        if(waitForInput(PASTE_TIMEOUT)) {
+            if(!keys.fill(STDIN_FILENO)) terminated = true;
+            last = chrono::steady_clock::now();
+        }
+        else if(chrono::steady_clock::now() - last >= chrono::milliseconds(PASTE_TIMEOUT)) break;
+    }
+
+    string text;
+    text.reserve(raw.size());
+    for(size_t i = 0; i < raw.size(); i++) {
+        if(raw[i] == '\r' || raw[i] == '\n') {
+            text += eol;
+            if(raw[i] == '\r' && i + 1 < raw.size() && raw[i + 1] == '\n') i++;
         }
-        return '\x1b';
+        else text += raw[i];
     }
-    return ch;
+    return text;
 }
 
 void Editor::scroll() {
+    if(softWrap) {
+        scrollWrapped();
+        return;
+    }
     if(cursorY < rowOffset) rowOffset = cursorY;
-    if(cursorY >= rowOffset + screenRows) rowOffset = cursorY - screenRows + 1;
-    if(cursorX < colOffset) colOffset = cursorX;
-    if(cursorX >= colOffset + screenCols) colOffset = cursorX - screenCols + 1;
+    if(cursorY >= rowOffset + screenRows - 1) rowOffset = cursorY - screenRows + 2; // last row is the status bar
+    int col = cursorColumn();
+    if(col < colOffset) colOffset = col;
+    if(col >= colOffset + textCols()) colOffset = col - textCols() + 1;
+}
+
+// Soft wrap: keeps the cursor's visual line on screen. Distances are taken
+// from the wrap index, after laying out the rows between the top and the
+// cursor when they are few enough to be on screen.
+void Editor::scrollWrapped() {
+    int lines = buffer.lineCount();
+    if(wrapCols != textCols()) buildWrapIndex();
+    else if(wrapIndex.rows() != lines) { // lines indexed since the last frame
+        int from = max(min(wrapIndex.rows(), lines) - 1, 0);
+        vector<uint32_t> counts(lines - from);
+        for(int y = from; y < lines; y++) counts[y - from] = estimateLines(y);
+        wrapIndex.splice(from, wrapIndex.rows() - from, counts);
+    }
+
+    int numRows = screenRows - 1;
+    colOffset = 0;
+    rowSub = min(rowSub, (int)wrapsOf(rowOffset).size()); // the top row may have got shorter
+    int sub = cursorSub();
+    if(cursorY < rowOffset || (cursorY == rowOffset && sub < rowSub)) {
+        rowOffset = cursorY;
+        rowSub = sub;
+        return;
+    }
+    for(int y = rowOffset; y < cursorY && y - rowOffset < numRows; y++) wrapsOf(y);
+    if(wrapIndex.lineOf(cursorY) + sub - visualTop() < (size_t)numRows) return;
+
+    // Below the screen: the cursor goes on the last row
+    int above = sub;
+    rowOffset = cursorY;
+    while(above < numRows - 1 && rowOffset > 0) above += wrapsOf(--rowOffset).size() + 1;
+    rowSub = max(above - (numRows - 1), 0);
+}
+
+size_t Editor::visualTop() {
+    return wrapIndex.lineOf(rowOffset) + rowSub;
+}
+
+// Where the cursor goes on screen
+void Editor::cursorOnScreen(int& y, int& x) {
+    if(!softWrap) {
+        y = cursorY - rowOffset;
+        x = cursorColumn() - colOffset;
+        return;
+    }
+    int sub = cursorSub();
+    const vector<int>& wraps = wrapsOf(cursorY);
+    const WidthMap& w = widthsOf(cursorY, cursorX, 0);
+    y = (int)(wrapIndex.lineOf(cursorY) + sub - visualTop());
+    x = w.column(cursorX) - (sub > 0 ? w.glyph(wraps[sub - 1]).col : 0);
+}
+
+// Moves (y, sub), visual line sub of row y, n visual lines down (up if
+// n < 0), stopping at either end of the document. The wrap index only
+// estimates rows that haven't been laid out, so every row on the way is laid
+// out and the distance is exact; this costs one layout per row passed.
+void Editor::walkVisual(int& y, int& sub, int n) {
+    int moved = 0, lines = buffer.lineCount();
+    while(moved < n) {
+        int step = min(n - moved, (int)wrapsOf(y).size() - sub);
+        sub += step;
+        moved += step;
+        if(moved == n || y + 1 >= lines) break;
+        y++;
+        sub = 0;
+        moved++;
+    }
+    while(moved > n) {
+        int step = min(moved - n, sub);
+        sub -= step;
+        moved -= step;
+        if(moved == n || y == 0) break;
+        y--;
+        sub = (int)wrapsOf(y).size();
+        moved--;
+    }
+}
+
+// Moves the cursor n visual lines down (up if n < 0) with soft wrap on,
+// keeping its column on screen
+void Editor::moveVisual(int n) {
+    int sub = cursorSub();
+    const WidthMap& from = widthsOf(cursorY, buffer.lineLength(cursorY), 0);
+    int col = from.column(cursorX) - (sub > 0 ? from.glyph(wrapsOf(cursorY)[sub - 1]).col : 0);
+
+    walkVisual(cursorY, sub, n);
+    const vector<int>& wraps = wrapsOf(cursorY);
+    const WidthMap& w = widthsOf(cursorY, buffer.lineLength(cursorY), 0);
+    size_t first = sub > 0 ? wraps[sub - 1] : 0;
+    size_t last = sub < (int)wraps.size() ? wraps[sub] - 1 : w.glyphs(); // the end of the visual line is the start of the next
+    cursorX = w.glyph(min(w.glyphAtColumn(w.glyph(first).col + col), last)).byte;
+}
+
+// PageUp/PageDown and half-page jumps: the view and the cursor move n rows
+// down (up if n < 0), so the cursor stays where it is on screen. Only the
+// rows that end up on screen get highlighted.
+void Editor::jumpRows(int n) {
+    int numRows = screenRows - 1;
+    if(softWrap) {
+        int y = rowOffset, sub = rowSub;
+        walkVisual(y, sub, n);
+        if(n > 0) { // no further down than the last line at the bottom of the screen
+            int lastY = buffer.lineCount() - 1, lastSub = (int)wrapsOf(lastY).size();
+            walkVisual(lastY, lastSub, -(numRows - 1));
+            if(make_pair(y, sub) > make_pair(lastY, lastSub)) tie(y, sub) = max(make_pair(lastY, lastSub), make_pair(rowOffset, rowSub));
+        }
+        rowOffset = y;
+        rowSub = sub;
+        moveVisual(n);
+        return;
+    }
+    int lines = buffer.lineCount(), col = cursorColumn();
+    rowOffset = max(min(rowOffset + n, lines - numRows), n < 0 ? 0 : rowOffset);
+    cursorY = max(min(cursorY + n, lines - 1), 0);
+    cursorX = byteAtColumn(cursorY, col);
+}
+
+// Ctrl-E: long lines go on over the next screen rows instead of scrolling sideways
+void Editor::toggleSoftWrap() {
+    softWrap = !softWrap;
+    rowSub = 0;
+    colOffset = 0;
+    if(softWrap) buildWrapIndex();
+    else wrapIndex.clear();
+    rowDirty.clear();
+    setStatusMessage(softWrap ? "Soft wrap on" : "Soft wrap off");
+}
+
+// Counts every row at the screen width. Rows are estimated from their length
+// and counted exactly as they get laid out. The estimate is rough: breaking
+// at spaces, tabs and wide characters make a line take more visual lines,
+// multi-byte characters fewer. Moving by visual lines lays out the rows it
+// passes instead of trusting it.
+void Editor::buildWrapIndex() {
+    int lines = buffer.lineCount();
+    vector<uint32_t> counts(lines);
+    for(int y = 0; y < lines; y++) counts[y] = estimateLines(y);
+    wrapIndex.clear();
+    wrapIndex.splice(0, 0, counts);
+    wrapCols = textCols();
+    for(CachedRow& row : rowCache) row.laidOut = false;
+    otherY = -1;
+}
+
+uint32_t Editor::estimateLines(int y) {
+    return buffer.lineLength(y) / textCols() + 1;
+}
+
+// The columns left for text, with the overview ruler on
+int Editor::textCols() const {
+    return max(screenCols - (showOverview ? OVERVIEW_COLS : 0), 1);
+}
+
+// Ctrl-T: shows where the screen is in the whole document, what the text is
+// made of and which rows were edited since the last save
+void Editor::toggleOverview() {
+    showOverview = !showOverview;
+    if(showOverview) buildOverview();
+    else overview.clear();
+    rowDirty.clear();
+    setStatusMessage(showOverview ? "Overview on" : "Overview off");
+}
+
+// Every row with its length; the rest of the summary is filled in by summarizeRows()
+void Editor::buildOverview() {
+    int lines = buffer.lineCount();
+    vector<uint32_t> rows(lines);
+    for(int y = 0; y < lines; y++) rows[y] = Overview::row(buffer.lineLength(y), false);
+    overview.clear();
+    overview.splice(0, 0, rows);
+}
+
+// Highlights rows the overview hasn't summarized yet while the editor is
+// idle, for a bounded time and only until a key arrives, so a large file is
+// covered over the next frames
+void Editor::summarizeRows() {
+    if(!showOverview) return;
+    auto start = chrono::steady_clock::now();
+    string scratch;
+    vector<uint8_t> types;
+    for(int n = 0, y; (y = overview.nextPending()) >= 0; n++) {
+        if(n % 64 == 0 && (chrono::steady_clock::now() - start >= SUMMARY_BUDGET || keys.pending() || waitForInput(0))) break; // keys come first
+        Syntax::updateSyntax(buffer.lineView(y, scratch, 4096), types); // enough to tell what a row is
+        overview.summarize(y, types);
+    }
+}
+
+// The ruler on the right: every screen row stands for a run of rows of the
+// document. The first column shows the part that is on screen and runs with
+// edited rows, the second how long the rows are, colored by what most of
+// them are highlighted as.
+void Editor::drawOverview(int numRows) {
+    if(!showOverview) return;
+    int lines = buffer.lineCount();
+    if(overview.rows() != lines) { // lines indexed since the last frame
+        int from = max(min(overview.rows(), lines) - 1, 0);
+        vector<uint32_t> rows(lines - from);
+        for(int y = from; y < lines; y++) rows[y - from] = Overview::row(buffer.lineLength(y), false);
+        overview.splice(from, overview.rows() - from, rows);
+    }
+
+    int lastShown = rowOffset + numRows - 1;
+    if(softWrap) { // the rows on screen are laid out already
+        int sub = rowSub;
+        lastShown = rowOffset;
+        walkVisual(lastShown, sub, numRows - 1);
+    }
+    static const char* const eighths[] = {" ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█"};
+    int x = screenCols - OVERVIEW_COLS;
+    for(int y = 0; y < numRows; y++) {
+        int from = lines <= numRows ? y : (int)((long long)lines * y / numRows);
+        int to = lines <= numRows ? min(y + 1, lines) : (int)((long long)lines * (y + 1) / numRows);
+        if(from >= to) {
+            screen.put(y, x, ' ', HL_NORMAL);
+            screen.put(y, x + 1, ' ', HL_NORMAL);
+            continue;
+        }
+        Overview::Bucket b = overview.bucket(from, to);
+        bool shown = to > rowOffset && from <= lastShown;
+        screen.putGlyph(y, x, b.modified ? "•" : " ", 1, shown ? STATUS_STYLE : (uint8_t)HL_NORMAL);
+        size_t average = b.bytes / b.rows;
+        int level = (int)min<size_t>(8, (average * 8 + textCols() - 1) / textCols());
+        screen.putGlyph(y, x + 1, eighths[level], 1, b.type);
+    }
 }
 
 void Editor::setStatusMessage(const string& msg) {
@@ -341,44 +1065,77 @@ void Editor::setStatusMessage(const string& msg) {
 void Editor::drawStatusBar() {
     string status;
     if(!statusMessage.empty()) {
-        auto now = chrono::steady_clock::now();
-        auto elapsed = chrono::duration_cast<chrono::seconds>(now - statusTime).count();
-        if(elapsed > 2) statusMessage = "";
+        if(chrono::steady_clock::now() - statusTime >= STATUS_TIMEOUT) statusMessage = "";
         else status = statusMessage;
     }
 
-    if(status.empty()) status = fileName + " | " + to_string(cursorY + 1) + ":" + to_string(cursorX + 1);
-    if((int)status.size() > screenCols) status = status.substr(0, screenCols);
+    if(status.empty()) {
+        string lines;
+        if(buffer.indexed()) lines = to_string(buffer.lineCount()) + " lines" + (buffer.truncated() ? " (truncated)" : "");
+        else if(buffer.loadProgress() < 0) { // streamed input of unknown size
+            size_t bytes = buffer.loadedBytes();
+            lines = "loading " + (bytes >> 20 ? to_string(bytes >> 20) + " MB" : to_string(bytes >> 10) + " KB");
+        }
+        else lines = "loading " + to_string((int)(buffer.loadProgress() * 100)) + "%";
+        if(mapping.truncated()) lines += " (cut short on disk)";
+        // how far through the file the cursor is, by bytes
+        size_t total = buffer.size() + buffer.pendingBytes();
+        size_t pos = buffer.lineStart(cursorY) + cursorX;
+        string percent = to_string(total ? (int)(pos * 100 / total) : 100) + "%";
+        status = fileName + " | " + lines + " | " + to_string(cursorY + 1) + ":" + to_string(cursorColumn() + 1) + " " + percent;
+        if(showStats) { // cost of the previous frame
+            const FrameBuffer::Stats& st = frame.stats();
+            status += " | " + to_string(st.lastBytes) + " B " + to_string(st.lastWrites) + " write" + (st.lastWrites == 1 ? "" : "s");
+        }
+    }
+
+    status.resize(screenCols, ' ');
+    screen.text(screenRows - 1, 0, status, STATUS_STYLE); // inverted colors
+}
+
+// Language and theme for the current file name
+void Editor::loadSyntax() {
+    Syntax::loadLanguage(fileName);
+    Syntax::loadTheme("default");
+    applyTheme();
+}
 
-    // Invert colors for status bar
-    cout << "\x1b[7m";
-    cout << status;
-    for(int i = status.size(); i < screenCols; i++) cout << " ";
-    cout << "\x1b[m\r\n"; // Reset formatting
+// Escape sequences for the cell styles: the theme's token classes, then the status bar
+void Editor::applyTheme() {
+    const Theme& theme = Syntax::currentTheme;
+    palette.assign(theme.escapes.begin(), theme.escapes.end());
+    palette.push_back("\x1b[0;7m");
+    invalidateRows();
 }
 
 void Editor::openFile(const string& name) {
     fileName = name;
-    rows.clear();
-
-    ifstream file(name);
-    if(!file) {
-        setStatusMessage("Could not open file!");
-        return;
-    }
+    buffer.load("");
 
-    string line;
-    while(getline(file, line)) {
-        if(!line.empty() && line.back() == '\r') line.pop_back(); // Handle CRLF
-        rows.push_back(line);
+    // Map the file and index its lines lazily; lines keep their CRLF/LF endings
+    eolPending = false;
+    if(mapping.open(name)) {
+        eol = lineBreakOf(mapping.data(), mapping.size());
+        buffer.attach(mapping.data(), trimFinalBreak(mapping.data(), mapping.size()));
+    } else {
+        // Pipes and devices can't be mapped: read them in the background and
+        // show lines as they arrive
+        int fd = open(name.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd >= 0 && fstat(fd, &st) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        if(fd < 0 || !buffer.stream(fd, S_ISREG(st.st_mode) ? st.st_size : 0)) {
+            setStatusMessage("Could not open file!");
+            return;
+        }
+        eol = "\n";
+        eolPending = true;
     }
+    buffer.indexLines(screenRows);
 
-    if(rows.empty()) rows.push_back("");
-
-    Syntax::loadLanguage(fileName);
-    Syntax::loadTheme("default");
-    hl.assign(rows.size(), vector<int>());
-    for(int i = 0; i < (int)rows.size(); i++) Syntax::updateSyntax(rows, hl, i);
+    loadSyntax(); // rows are highlighted as they are drawn
 
     setStatusMessage("File loaded successfully.");
 }
@@ -388,13 +1145,15 @@ void Editor::saveFile() {
         setStatusMessage("Save aborted: No file name.");
         return;
     }
-    ofstream file(fileName);
-    if(!file) {
+    if(!confirmCutShort()) {
+        setStatusMessage("Save aborted.");
+        return;
+    }
+    if(!writeFile(fileName)) {
         setStatusMessage("Could not save file!");
         return;
     }
-    for(const auto& line : rows) file << line << "\n";
-    setStatusMessage("File saved successfully.");
+    setStatusMessage(buffer.streaming() ? "Saved what has arrived so far; the input is still open." : "File saved successfully.");
 }
 
 void Editor::saveFileAs() {
@@ -403,21 +1162,20 @@ void Editor::saveFileAs() {
         setStatusMessage("Save as aborted.");
         return;
     }
+    if(!confirmCutShort()) {
+        setStatusMessage("Save as aborted.");
+        return;
+    }
 
     fileName = newFileName;
-    ofstream file(fileName);
-    if(!file) {
+    if(!writeFile(fileName)) {
         setStatusMessage("Could not save file!");
         return;
     }
-    for(const auto& line : rows) file << line << "\n";
 
-    Syntax::loadLanguage(fileName);
-    Syntax::loadTheme("default");
-    hl.assign(rows.size(), vector<int>());
-    for(int i = 0; i < (int)rows.size(); i++) Syntax::updateSyntax(rows, hl, i);
+    loadSyntax();
 
-    setStatusMessage("File saved as " + fileName);
+    setStatusMessage("File saved as " + fileName + (buffer.streaming() ? " (as far as it has arrived)" : ""));
 }
 
 void Editor::renameFile() {
@@ -435,72 +1193,163 @@ void Editor::renameFile() {
     if(fileName == "[No Name]") {
         // Treat as save-as for an unnamed buffer
         fileName = newName;
-        ofstream out(fileName);
-        if(!out) {
+        if(!writeFile(fileName)) {
             setStatusMessage("Could not create file!");
             fileName = "[No Name]";
             return;
         }
-        for(const auto& line : rows) out << line << "\n";
     } else {
+        if(!confirmCutShort()) {
+            setStatusMessage("Rename aborted.");
+            return;
+        }
         // Ensure current contents are written, then rename the file on disk
-        saveFile();
+        writeFile(fileName);
         std::error_code ec;
         std::filesystem::rename(fileName, newName, ec);
         if(ec) {
             // Fallback: write to new file and remove the old one
-            ofstream out(newName);
-            if(!out) {
+            if(!writeFile(newName)) {
                 setStatusMessage("Rename failed: cannot write new file.");
                 return;
             }
-            for(const auto& line : rows) out << line << "\n";
             std::filesystem::remove(fileName, ec); // ignore error
         }
         fileName = newName;
     }
 
     // Reload syntax highlighting for the new file extension
-    Syntax::loadLanguage(fileName);
-    Syntax::loadTheme("default");
-    hl.assign(rows.size(), vector<int>());
-    for(int i = 0; i < (int)rows.size(); i++) Syntax::updateSyntax(rows, hl, i);
+    loadSyntax();
 
     setStatusMessage("Renamed to " + fileName);
 }
 
+// A streamed file's line break style is known once its first line has arrived
+void Editor::detectLineBreak() {
+    if(!eolPending || (buffer.lineCount() < 2 && !buffer.indexed())) return;
+    if(buffer.lineCount() > 1) eol = buffer.lineStart(1) - buffer.lineLength(0) == 2 ? "\r\n" : "\n";
+    eolPending = false;
+}
+
+// The rest of a file cut short on disk reads as NUL bytes, so writing the
+// buffer out would put them in the file; only on a yes
+bool Editor::confirmCutShort() {
+    if(!mapping.truncated()) return true;
+    string answer = promptForInput("File was cut short on disk; save anyway? (y/N) ");
+    return answer == "y" || answer == "Y";
+}
+
+// Writes the buffer to a temporary file and renames it over path, so a file the
+// buffer still maps is replaced rather than truncated underneath it. Input that
+// is still streaming in is written as far as it has arrived, without waiting
+// for its end.
+bool Editor::writeFile(const string& path) {
+    detectLineBreak();
+
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path target = path;
+    if(fs::is_symlink(target, ec)) {
+        target = fs::canonical(target, ec); // replace the link's target, not the link
+        if(ec) return false;
+    }
+
+    fs::path tmp = target;
+    tmp += ".tedit~";
+    {
+        ofstream out(tmp, ios::binary);
+        if(!out) return false;
+        buffer.write(out);
+        out << eol;
+        if(!out.flush()) {
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+
+    fs::perms mode = fs::status(target, ec).permissions();
+    if(!ec) fs::permissions(tmp, mode, ec);
+    fs::rename(tmp, target, ec);
+    if(ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    overview.clearModified();
+    return true;
+}
+
+void Editor::goToLine() {
+    string input = promptForInput("Go to line[:col]: ");
+    if(input.empty()) return;
+    int line = 0, col = 1;
+    if(sscanf(input.c_str(), "%d:%d", &line, &col) < 1 || line < 1 || col < 1) {
+        setStatusMessage("Invalid line number.");
+        return;
+    }
+
+    buffer.indexLines(line);
+    cursorY = min(line, buffer.lineCount()) - 1;
+    cursorX = byteAtColumn(cursorY, col - 1);
+}
+
+// Jumps to a 0-based byte offset in the file, as reported by tools like grep -b
+void Editor::goToOffset() {
+    string input = promptForInput("Go to byte offset: ");
+    if(input.empty()) return;
+    unsigned long long offset = 0;
+    if(sscanf(input.c_str(), "%llu", &offset) != 1) {
+        setStatusMessage("Invalid byte offset.");
+        return;
+    }
+
+    // The offset may lie past the lines indexed so far
+    while(!buffer.indexed() && buffer.size() <= offset) {
+        int lines = buffer.lineCount();
+        buffer.indexLines(lines + 1);
+        if(buffer.lineCount() == lines) break; // streamed input that hasn't arrived yet
+    }
+    size_t pos = min((size_t)offset, buffer.size());
+    cursorY = buffer.lineOf(pos);
+    cursorX = min((int)(pos - buffer.lineStart(cursorY)), buffer.lineLength(cursorY));
+    const WidthMap& w = widthsOf(cursorY, cursorX, 0);
+    cursorX = w.glyph(w.glyphAt(cursorX)).byte; // the start of the character it falls in
+}
+
 string Editor::promptForInput(const string& prompt) {
     string input = "";
 
     while(true) {
-        // Clear screen and draw content rows (excluding status bar)
-        cout << "\x1b[2J\x1b[H";
+        updateWindowSize();
+        scroll();
+        screen.resize(screenRows, screenCols);
+        // Content rows (excluding status bar) only change if they were dirty
         drawContentRows(screenRows - 1);
-        
-        cout << "\r\n\x1b[K"; // New line and clear line
-        cout << "\x1b[7m"; // Invert colors
+        drawOverview(screenRows - 1);
+
+        // The prompt replaces the status bar, cursor at the end of the input
         string status = prompt + input;
-        if((int)status.size() > screenCols) status = status.substr(0, screenCols);
-        cout << status;
-        for(int i = status.size(); i < screenCols; i++) cout << " ";
-        cout << "\x1b[m\x1b[K"; // Reset formatting and clear to end
-        
-        // Position cursor at end of input on status bar
-        int cursorCol = prompt.length() + input.length() + 1;
-        cout << "\x1b[" << screenRows << ";" << cursorCol << "H";
-        cout << "\x1b[?25h"; // Show cursor
-        cout.flush();
-
-        char ch;
-        ssize_t n = read(STDIN_FILENO, &ch, 1);
-        if(n <= 0) continue;
-
-        if(ch == '\r') return input; // Enter
-        else if((unsigned char)ch == 27) return ""; // Escape
-        else if(ch == 127 || ch == 8) { // Backspace
+        status.resize(screenCols, ' ');
+        screen.text(screenRows - 1, 0, status, STATUS_STYLE);
+        int cursorCol = min((int)(prompt.length() + input.length()), screenCols - 1);
+        screen.present(frame, palette, screenRows - 1, cursorCol);
+        frame.flush();
+
+        int key = readKey();
+        if(terminated) return "";
+        if(key == -1) continue; // resized: draw again
+
+        if(key == '\r') return input; // Enter
+        else if(key == 27) return ""; // Escape
+        else if(key == PASTE_START) { // the first line of it
+            string text = readPaste();
+            for(char c : text.substr(0, text.find_first_of("\r\n"))) {
+                if(isprint((unsigned char)c)) input += c;
+            }
+        }
+        else if(key == 127 || key == 8) { // Backspace
             if(!input.empty()) input.pop_back();
-        } else if(isprint((unsigned char)ch)) {
-            input += ch;
+        } else if(key < 128 && isprint(key)) {
+            input += (char)key;
         }
     }
 }
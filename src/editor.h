@@ -1,34 +1,40 @@
 #pragma once
 #include "syntax.h"
+#include "buffer.h"
+#include "mappedfile.h"
+#include "framebuffer.h"
+#include "screen.h"
+#include "widthmap.h"
+#include "wrapindex.h"
+#include "overview.h"
+#include "eventloop.h"
+#include "keyreader.h"
 #include <string>
 #include <vector>
 #include <chrono>
 using namespace std;
 
-enum EditorKey {
-    ARROW_LEFT = 1000,
-    ARROW_RIGHT,
-    ARROW_UP,
-    ARROW_DOWN
-};
-
 class Editor {
     public:
         Editor();
-        bool processKeypress();
+        bool processInput();
         void refreshScreen();
         void openFile(const string& name);
         void saveFile();
         void saveFileAs();
         void renameFile();
+        void goToLine();
+        void goToOffset();
         
     private:
+        bool processKeypress();
+
         // Undo/Redo support
         enum class ActionType { InsertText, DeleteRange, SplitLine, JoinLine };
         struct Action {
             ActionType type;
             int y, x;                 // position reference
-            string text;              // inserted text or deleted text or suffix (for split)
+            string text;              // inserted text, deleted text, or the line break (for split/join)
             string aux;               // auxiliary: indent for split, or unused
             int beforeX = 0, beforeY = 0; // cursor before action
             int afterX = 0, afterY = 0;   // cursor after action
@@ -43,26 +49,100 @@ class Editor {
         // low-level text ops (no history recording)
         void insertTextAt(int y, int x, const string& s);
         void deleteRangeAt(int y, int x, int len);
+        void rowsChanged(int y, int oldCount, int newCount, bool edited = true);
+        void invalidateRows();
 
         void drawRows();
         void drawContentRows(int numRows);
+        void drawWrappedRows(int numRows);
+        void drawOverview(int numRows);
+        void toggleOverview();
+        void buildOverview();
+        void summarizeRows();
+        int textCols() const;
+        void slideRowCache(int numRows);
+        void shiftDrawnRows(int numRows, int moved);
+        void drawGlyphs(int y, const vector<uint8_t>& types, string_view line, const WidthMap& w, size_t first, size_t last, int left);
         void insertChar(char ch);
-        int getIndentLevel(const string& line);
+        struct CachedRow;
+        CachedRow& cachedRow(int y);
+        string_view highlightRow(int y, CachedRow& row, size_t limit, string& scratch);
+        const WidthMap& widthsOf(int y, size_t x, int col);
+        const vector<int>& wrapsOf(int y);
+        int cursorColumn();
+        int cursorSub();
+        int byteAtColumn(int y, int col);
+        int getIndentLevel(string_view line);
+        void toggleSoftWrap();
+        void buildWrapIndex();
+        uint32_t estimateLines(int y);
+        size_t visualTop();
+        void walkVisual(int& y, int& sub, int n);
+        void moveVisual(int n);
+        void jumpRows(int n);
         void scroll();
+        void scrollWrapped();
+        void cursorOnScreen(int& y, int& x);
         void drawStatusBar();
+        void loadSyntax();
+        void applyTheme();
         void setStatusMessage(const string& msg);
         int readKey();
+        string readPaste();
         string promptForInput(const string& prompt);
+        bool writeFile(const string& path);
+        bool confirmCutShort(); // asks before saving a file truncated underneath the buffer
+        void detectLineBreak();
+        bool waitForInput(int timeoutMs);
+        int nextFrameDue();
+        void updateWindowSize();
 
         int cursorX, cursorY;
-        int rowOffset = 0, colOffset = 0, screenRows = 24, screenCols = 80;
-        vector<string> rows;
+        int rowOffset = 0, colOffset = 0, screenRows = 24, screenCols = 80; // until the terminal tells its size
+        bool softWrap = false; // Ctrl-E: long lines go on over the next screen rows
+        int rowSub = 0;        // with soft wrap, the visual line of row rowOffset at the top of the screen
+        WrapIndex wrapIndex;   // visual lines of every row while soft wrap is on
+        int wrapCols = 0;      // the width wrapIndex was built for, 0 to build it again
+        bool showOverview = false; // Ctrl-T: the overview ruler on the right
+        Overview overview;         // summary of every row while the ruler is shown
+        EventLoop events;   // keys, signals, timers and wakeups; set up before any thread starts
+        bool terminated = false; // SIGTERM: quit as with Ctrl-Q
+        KeyReader keys;          // input read so far, decoded into keys as they are handled
+        MappedFile mapping; // backs the buffer's original text; declared first so it outlives the buffer's indexer threads
+        TextBuffer buffer;
+        string eol = "\n"; // line break style of the loaded file
+        bool eolPending = false; // still streaming in and no line break seen yet
+        bool followEnd = false;  // after Ctrl-End while loading: the cursor stays on the last line
+
+        Screen screen;     // what the terminal shows; frames are drawn here and diffed
+        FrameBuffer frame; // everything sent goes here and out in one write per frame
+        vector<string> palette; // escape sequence for each cell style
+        chrono::steady_clock::time_point lastFrame;
+        int lastKey = -1, keyRepeats = 0; // a held key comes in as the same key over and over
+        chrono::steady_clock::time_point lastKeyTime; // when it arrived
+        bool keyHeld = false; // this key came in a read of its own, spaced like key repeat
+        bool showStats = false; // TEDIT_STATS: show the cost of each frame in the status bar
 
         string fileName = "[No Name]";
         string statusMessage;
         chrono::steady_clock::time_point statusTime;
 
-        vector<vector<int>> hl;
+        // Highlighting, column widths and wrapping of the rows on screen, kept
+        // between frames: rowCache[i] is file row cacheFirst + i. Edits splice
+        // it and scrolling slides it.
+        struct CachedRow {
+            vector<uint8_t> types;
+            size_t limit = 0; // bytes of the line looked at, 0 if it needs highlighting
+            WidthMap widths;
+            vector<int> wraps; // see wrapLine(), once laidOut
+            bool laidOut = false;
+        };
+        int cacheFirst = 0;
+        vector<CachedRow> rowCache;
+        CachedRow otherRow; // the last row looked at that isn't on screen
+        int otherY = -1;
+        vector<char> rowDirty; // screen rows that must be drawn again
+        int drawnRowOffset = 0, drawnRowSub = 0, drawnColOffset = 0, drawnCols = 0; // what the drawn rows were laid out for
 
         vector<Action> undoStack;
         vector<Action> redoStack;
@@ -0,0 +1,86 @@
+#include "eventloop.h"
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <cstdint>
+#include <initializer_list>
+using namespace std;
+
+EventLoop::EventLoop() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGWINCH);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr); // delivered through the signalfd instead
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(epollFd < 0) return;
+    for(int fd : {(int)STDIN_FILENO, signalFd, timerFd, eventFd}) {
+        if(fd < 0) continue;
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+EventLoop::~EventLoop() {
+    for(int fd : {epollFd, signalFd, timerFd, eventFd}) {
+        if(fd >= 0) close(fd);
+    }
+}
+
+EventLoop::Event EventLoop::wait(int timeoutMs) {
+    if(epollFd < 0) { // no epoll: keys only
+        struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+        return poll(&in, 1, timeoutMs) > 0 ? INPUT : TIMEOUT;
+    }
+
+    struct epoll_event ready[4];
+    int n;
+    do n = epoll_wait(epollFd, ready, 4, timeoutMs);
+    while(n < 0 && errno == EINTR);
+    if(n <= 0) return TIMEOUT;
+
+    // Signals first, then keys; whatever isn't reported now is still ready next time
+    bool input = false, timer = false, wake = false;
+    for(int i = 0; i < n; i++) {
+        int fd = ready[i].data.fd;
+        if(fd == signalFd) {
+            struct signalfd_siginfo info;
+            bool resized = false;
+            while(read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+                if(info.ssi_signo == SIGTERM) return TERMINATE;
+                resized = true;
+            }
+            if(resized) return RESIZE;
+        }
+        else if(fd == STDIN_FILENO) input = true;
+        else if(fd == timerFd) timer = true;
+        else if(fd == eventFd) wake = true;
+    }
+    if(input) return INPUT;
+
+    uint64_t count;
+    if(wake && read(eventFd, &count, sizeof(count)) == sizeof(count)) return WAKE;
+    if(timer && read(timerFd, &count, sizeof(count)) == sizeof(count)) return TIMER;
+    return TIMEOUT; // drained by someone else in the meantime
+}
+
+void EventLoop::setTimer(int ms) {
+    if(timerFd < 0) return;
+    struct itimerspec spec = {};
+    if(ms >= 0) {
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = (long)(ms % 1000) * 1000000 + (ms == 0); // all zero would disarm it
+    }
+    timerfd_settime(timerFd, 0, &spec, nullptr);
+}
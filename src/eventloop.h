@@ -0,0 +1,27 @@
+#pragma once
+using namespace std;
+
+// Everything the editor waits for, on one epoll instance: keys on stdin,
+// SIGWINCH and SIGTERM through a signalfd, a one-shot timerfd for frames that
+// are due without input (an expiring status message, loading progress), and
+// an eventfd that background threads write to when they finish some work.
+// The signals are blocked for the whole process, so construct the loop before
+// starting any threads.
+class EventLoop {
+    public:
+        enum Event { TIMEOUT, INPUT, RESIZE, TERMINATE, TIMER, WAKE };
+
+        EventLoop();
+        ~EventLoop();
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        // The next event, or TIMEOUT after timeoutMs (-1 waits for good). Input
+        // is left to be read; the other events are consumed.
+        Event wait(int timeoutMs);
+        void setTimer(int ms); // replaces the previous one; -1 cancels it
+        int wakeFd() const { return eventFd; } // background threads write an 8-byte count here
+
+    private:
+        int epollFd = -1, signalFd = -1, timerFd = -1, eventFd = -1;
+};
@@ -0,0 +1,36 @@
+#include "framebuffer.h"
+#include <cerrno>
+#include <unistd.h>
+using namespace std;
+
+void FrameBuffer::appendNumber(long n) {
+    char digits[24];
+    int len = 0;
+    unsigned long v = n < 0 ? -(unsigned long)n : n;
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    if(n < 0) buf.push_back('-');
+    while(len) buf.push_back(digits[--len]);
+}
+
+void FrameBuffer::flush() {
+    size_t done = 0, writes = 0;
+    while(done < buf.size()) {
+        ssize_t n = write(STDOUT_FILENO, buf.data() + done, buf.size() - done);
+        writes++;
+        if(n < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            break; // the terminal is gone; drop the frame
+        }
+        done += n;
+    }
+
+    counters.frames++;
+    counters.writes += writes;
+    counters.bytes += done;
+    counters.lastWrites = writes;
+    counters.lastBytes = done;
+    buf.clear();
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Collects everything drawn for one frame in a single contiguous buffer and
+// hands it to the terminal in one write(2) (more only if the terminal takes a
+// partial write). Counts the writes and bytes of each frame so their cost can
+// be shown in the status bar.
+class FrameBuffer {
+    public:
+        struct Stats {
+            size_t frames = 0, writes = 0, bytes = 0; // totals
+            size_t lastWrites = 0, lastBytes = 0;     // of the most recent frame
+        };
+
+        void append(string_view s) { buf.append(s.data(), s.size()); }
+        void append(char c) { buf.push_back(c); }
+        void append(size_t count, char c) { buf.append(count, c); }
+        void appendNumber(long n);
+        void flush(); // writes the frame to stdout and starts a new one
+        void clear() { buf.clear(); } // drops the frame unsent
+        size_t size() const { return buf.size(); }
+        const Stats& stats() const { return counters; }
+
+    private:
+        string buf; // keeps its capacity across frames
+        Stats counters;
+};
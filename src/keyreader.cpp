@@ -0,0 +1,213 @@
+#include "keyreader.h"
+#include "unicode.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iterator>
+using namespace std;
+
+static const size_t MAX_SEQUENCE = 64; // longer control sequences are dropped
+static const char PASTE_END_MARK[] = "\x1b[201~";
+
+// Keys by the final byte of CSI and SS3 sequences
+struct FinalKey { char final; int key; };
+static const FinalKey FINAL_KEYS[] = {
+    {'A', ARROW_UP}, {'B', ARROW_DOWN}, {'C', ARROW_RIGHT}, {'D', ARROW_LEFT},
+    {'H', HOME_KEY}, {'F', END_KEY}, {'Z', BACK_TAB},
+    {'P', F1_KEY}, {'Q', F1_KEY + 1}, {'R', F1_KEY + 2}, {'S', F1_KEY + 3},
+};
+
+// Keys by the number of CSI <number> ~ sequences (VT220 and rxvt)
+static const int TILDE_KEYS[] = {
+    0, HOME_KEY, INSERT_KEY, DEL_KEY, END_KEY, PAGE_UP, PAGE_DOWN, HOME_KEY, END_KEY, 0,
+    0, F1_KEY, F1_KEY + 1, F1_KEY + 2, F1_KEY + 3, F1_KEY + 4, 0, F1_KEY + 5, F1_KEY + 6, F1_KEY + 7,
+    F1_KEY + 8, F1_KEY + 9, 0, F1_KEY + 10, F1_KEY + 11,
+};
+
+static int finalKey(unsigned char c) {
+    for(const FinalKey& f : FINAL_KEYS) {
+        if(f.final == c) return f.key;
+    }
+    return 0;
+}
+
+// xterm sends modifiers as a second parameter: 1 + (1 Shift, 2 Alt, 4 Ctrl, 8 Meta)
+static int modifierBits(int param) {
+    int m = max(param - 1, 0), bits = 0;
+    if(m & 1) bits |= KEY_SHIFT;
+    if(m & (2 | 8)) bits |= KEY_ALT;
+    if(m & 4) bits |= KEY_CTRL;
+    return bits;
+}
+
+// The key a complete CSI sequence (parameters and final byte) stands for;
+// KEY_REPORT for anything else, like the terminal answering a query
+static int csiKey(const string& seq) {
+    int params[2] = {0, 1}, n = 0;
+    for(size_t i = 0; i + 1 < seq.size(); i++) {
+        char c = seq[i];
+        if(c == ';' && n < 1) params[++n] = 0;
+        else if(c >= '0' && c <= '9' && params[n] < 1000) params[n] = params[n] * 10 + (c - '0');
+        else return KEY_REPORT; // private parameters, intermediate bytes or too many parameters
+    }
+    char final = seq.back();
+    int key = 0;
+    if(final == '~' && (params[0] == 200 || params[0] == 201)) return params[0] == 200 ? PASTE_START : PASTE_END;
+    if(final == '~') key = params[0] < (int)size(TILDE_KEYS) ? TILDE_KEYS[params[0]] : 0;
+    else if(params[0] <= 1) key = finalKey(final);
+    return key ? key | modifierBits(params[1]) : KEY_REPORT;
+}
+
+bool KeyReader::fill(int fd) {
+    size_t tail = (head + count) & (SIZE - 1);
+    size_t space = min(SIZE - count, SIZE - tail);
+    if(space == 0) return true; // decoding makes room again
+    ssize_t n = read(fd, ring + tail, space);
+    if(n < 0) return errno == EINTR || errno == EAGAIN;
+    count += n;
+    if(n > 0) reads.push_back({taken + count, chrono::steady_clock::now()});
+    return n > 0;
+}
+
+int KeyReader::next() {
+    while(count > 0) {
+        size_t used;
+        int key = decode(used);
+        if(used == 0) { // the rest of the sequence hasn't arrived
+            if(!partial) partialSince = chrono::steady_clock::now();
+            partial = true;
+            return -1;
+        }
+        consume(used);
+        if(key != -1) return key;
+    }
+    return -1;
+}
+
+int KeyReader::peek() {
+    while(count > 0) {
+        size_t used;
+        int key = decode(used);
+        if(used == 0 || key != -1) return key;
+        consume(used); // bytes that make no key
+    }
+    return -1;
+}
+
+int KeyReader::timeLeft() const {
+    if(!partial) return -1;
+    auto left = ESC_TIMEOUT - (chrono::steady_clock::now() - partialSince);
+    return max(0, (int)chrono::ceil<chrono::milliseconds>(left).count());
+}
+
+int KeyReader::flush() {
+    int key = -1;
+    if(partial && at(0) == 0x1b) key = count == 1 ? 0x1b : count == 2 ? at(1) | KEY_ALT : -1;
+    if(partial) consume(count); // everything buffered is the unfinished sequence
+    return key;
+}
+
+bool KeyReader::paste(string& text) {
+    const size_t markLen = sizeof(PASTE_END_MARK) - 1;
+    size_t k = 0;
+    bool found = false;
+    for(; k < count; k++) {
+        if(at(k) != 0x1b) continue;
+        size_t m = 1;
+        while(m < markLen && k + m < count && at(k + m) == (unsigned char)PASTE_END_MARK[m]) m++;
+        if(m == markLen) {
+            found = true;
+            break;
+        }
+        if(k + m == count) break; // may be the start of the end marker: wait for the rest
+    }
+    for(size_t j = 0; j < k; j++) text += (char)at(j);
+    consume(found ? k + markLen : k);
+    return found;
+}
+
+void KeyReader::consume(size_t n) {
+    head = (head + n) & (SIZE - 1);
+    count -= n;
+    partial = false;
+    taken += n;
+    while(!reads.empty() && reads.front().end < taken) reads.pop_front();
+    if(!reads.empty()) keyTime = reads.front().at; // the read the last byte taken came in
+}
+
+// Decodes the key at the front of the buffer, used set to the bytes it takes
+// (0 if it isn't complete yet). Bytes that make no key decode to -1.
+int KeyReader::decode(size_t& used) {
+    enum State { GROUND, ESCAPE, CSI, SS3, UTF8 };
+    State state = GROUND;
+    size_t need = 0;
+    for(size_t k = 0; k < count; k++) {
+        unsigned char c = at(k);
+        switch(state) {
+            case GROUND:
+                if(c == 0x1b) state = ESCAPE;
+                else if(c < 0x80) {
+                    used = 1;
+                    return c;
+                }
+                else {
+                    need = c >= 0xF8 ? 0 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+                    if(need == 0) { // not the start of a character
+                        used = 1;
+                        return -1;
+                    }
+                    state = UTF8;
+                }
+                break;
+            case ESCAPE:
+                if(c == '[') {
+                    state = CSI;
+                    sequence.clear();
+                }
+                else if(c == 'O') state = SS3;
+                else if(c == 0x1b || c >= 0x80) { // Escape, then whatever follows on its own
+                    used = 1;
+                    return 0x1b;
+                }
+                else { // Alt sends an ESC first
+                    used = 2;
+                    return c | KEY_ALT;
+                }
+                break;
+            case CSI:
+                if(c >= 0x40 && c <= 0x7e) {
+                    sequence += (char)c;
+                    used = k + 1;
+                    return csiKey(sequence);
+                }
+                if(c < 0x20 || c > 0x3f || k >= MAX_SEQUENCE) { // broken off: dropped
+                    used = k;
+                    return -1;
+                }
+                sequence += (char)c; // parameter and intermediate bytes
+                break;
+            case SS3: {
+                int key = finalKey(c);
+                used = k + 1;
+                return key ? key : -1;
+            }
+            case UTF8:
+                if((c & 0xC0) != 0x80) { // cut short
+                    used = k;
+                    return -1;
+                }
+                if(k + 1 == need) {
+                    char bytes[4];
+                    for(size_t j = 0; j < need; j++) bytes[j] = (char)at(j);
+                    size_t i = 0;
+                    uint32_t cp = decodeUtf8(bytes, need, i);
+                    used = need;
+                    return cp == REPLACEMENT_CHAR || i != need ? -1 : (int)(TEXT_CHAR | cp);
+                }
+                break;
+        }
+    }
+    used = 0;
+    return -1;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+using namespace std;
+
+enum EditorKey {
+    ARROW_LEFT = 1000,
+    ARROW_RIGHT,
+    ARROW_UP,
+    ARROW_DOWN,
+    HOME_KEY,
+    END_KEY,
+    PAGE_UP,
+    PAGE_DOWN,
+    INSERT_KEY,
+    DEL_KEY,
+    BACK_TAB,        // Shift-Tab
+    F1_KEY,          // F1_KEY + n - 1 for Fn, up to F12
+    PASTE_START = F1_KEY + 12, // bracketed paste: the text follows, see KeyReader::paste()
+    PASTE_END,
+    KEY_REPORT, // a control sequence that isn't a key; see KeyReader::report()
+    TEXT_CHAR = 1 << 21, // | code point: a typed character past ASCII
+    KEY_SHIFT = 1 << 22, // modifiers, | any key above
+    KEY_ALT = 1 << 23,
+    KEY_CTRL = 1 << 24
+};
+
+// Turns what the terminal sends into keys. Input is read in blocks of
+// whatever has arrived into a ring buffer and decoded from there: plain
+// bytes, UTF-8 sequences, and escape sequences (CSI with parameters and
+// xterm-style modifiers, SS3, Alt as an ESC prefix). An ESC that isn't
+// followed by the rest of a sequence within ESC_TIMEOUT is the Escape key.
+class KeyReader {
+    public:
+        static constexpr size_t SIZE = 8192; // a power of two
+        static constexpr auto ESC_TIMEOUT = chrono::milliseconds(25);
+
+        // Reads what has arrived on fd (one read() into the free space);
+        // false at the end of input or on an error
+        bool fill(int fd);
+        // The next whole key, -1 if none is buffered yet
+        int next();
+        int peek(); // the key next() would return, left in the buffer
+        bool pending() const { return count > 0; } // bytes waiting to be decoded
+        // Milliseconds until the incomplete sequence at the front counts as
+        // typed as is (0: now), -1 if there is none
+        int timeLeft() const;
+        int flush(); // takes the incomplete sequence at the front: Escape, Alt-[ or nothing
+        // After PASTE_START: moves the pasted bytes buffered so far to the end
+        // of text, as is; true once the end of the paste was reached
+        bool paste(string& text);
+        // The parameters and final byte of the last KEY_REPORT sequence, after the CSI
+        const string& report() const { return sequence; }
+        // When the read that completed the last key taken came in; keys that
+        // arrived in one read all have the same time
+        chrono::steady_clock::time_point arrived() const { return keyTime; }
+
+    private:
+        unsigned char at(size_t k) const { return ring[(head + k) & (SIZE - 1)]; }
+        void consume(size_t n);
+        int decode(size_t& used);
+
+        unsigned char ring[SIZE];
+        size_t head = 0, count = 0;
+        bool partial = false; // the bytes at the front are the start of a sequence
+        chrono::steady_clock::time_point partialSince;
+        string sequence;
+        struct Read { size_t end; chrono::steady_clock::time_point at; }; // end: bytes taken in by then
+        deque<Read> reads; // the fills whose bytes are still buffered, oldest first
+        size_t taken = 0;  // bytes consumed so far
+        chrono::steady_clock::time_point keyTime;
+};
@@ -0,0 +1,198 @@
+#include "lineindexer.h"
+#include "linescan.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+
+static const size_t READ_BLOCK = 1 << 20;
+
+LineIndexer::~LineIndexer() {
+    stop();
+}
+
+void LineIndexer::start(const char* d, size_t s) {
+    stop();
+    base = d;
+    expectedSize = s;
+    for(size_t from = 0; from < s; from += CHUNK) {
+        chunks.emplace_back();
+        chunks.back().start = from;
+        chunks.back().end = min(s, from + CHUNK);
+    }
+    published = chunks.size();
+    complete = true;
+    stopping = false;
+
+    // A single chunk is scanned by whoever asks for it first
+    if(chunks.size() < 2) return;
+    size_t threads = min<size_t>(max(1u, thread::hardware_concurrency()), chunks.size());
+    for(size_t i = 0; i < threads; i++) workers.emplace_back(&LineIndexer::work, this);
+}
+
+bool LineIndexer::startStream(int fd, size_t expected) {
+    stop();
+    // Reserve address space up front so the data never moves while it is
+    // being read; pages are only committed as the input fills them. Strict
+    // overcommit settings may refuse large reservations, so back off.
+    for(size_t s = (size_t)1 << (sizeof(size_t) > 4 ? 40 : 30); s >= CHUNK; s >>= 2) {
+        void* p = mmap(nullptr, s, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED) continue;
+        region = (char*)p;
+        regionSize = s;
+        break;
+    }
+    if(!region) {
+        close(fd);
+        return false;
+    }
+
+    base = region;
+    expectedSize = expected;
+    complete = false;
+    overflow = false;
+    stopping = false;
+    workers.emplace_back(&LineIndexer::readStream, this, fd);
+    return true;
+}
+
+void LineIndexer::stop() {
+    stopping = true;
+    for(auto& t : workers) t.join();
+    workers.clear();
+    chunks.clear();
+    if(region) munmap(region, regionSize);
+    region = nullptr;
+    regionSize = 0;
+    base = nullptr;
+    expectedSize = taken = takenTo = 0;
+    next = published = finished = loaded = 0;
+    complete = true;
+}
+
+bool LineIndexer::take(vector<size_t>& breaks, bool wait) {
+    if(taken == published) return false;
+    Chunk* c;
+    {
+        lock_guard<mutex> lk(lock);
+        c = &chunks[taken];
+    }
+
+    if(c->state != DONE) {
+        if(!wait) return false;
+        int expected = PENDING;
+        if(c->state.compare_exchange_strong(expected, RUNNING)) scanChunk(*c);
+        else {
+            unique_lock<mutex> lk(lock);
+            chunkDone.wait(lk, [&] { return c->state == DONE; });
+        }
+    }
+
+    if(breaks.empty()) breaks.swap(c->breaks);
+    else breaks.insert(breaks.end(), c->breaks.begin(), c->breaks.end());
+    vector<size_t>().swap(c->breaks);
+    takenTo = c->end;
+    taken++;
+    return true;
+}
+
+double LineIndexer::progress() const {
+    if(!region) return published ? (double)finished / published : 1.0;
+    if(complete) return 1.0;
+    if(!expectedSize) return -1.0;
+    return min(1.0, (double)loaded / expectedSize);
+}
+
+void LineIndexer::work() {
+    while(!stopping) {
+        size_t k = next++;
+        if(k >= chunks.size()) break;
+        int expected = PENDING;
+        if(chunks[k].state.compare_exchange_strong(expected, RUNNING)) scanChunk(chunks[k]);
+    }
+}
+
+void LineIndexer::scanChunk(Chunk& c) {
+    scanLineBreaks(base, c.start, c.end, c.breaks);
+    {
+        lock_guard<mutex> lk(lock);
+        c.state = DONE;
+        finished++;
+    }
+    chunkDone.notify_all();
+    wake();
+}
+
+void LineIndexer::wake() {
+    uint64_t one = 1;
+    if(wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0) {} // a full counter already has a wakeup pending
+}
+
+// Length of a line break ending at `end`, or of a CR that may start one
+static size_t trailingBreak(const char* data, size_t from, size_t end, bool partialCR) {
+    if(end > from && data[end - 1] == '\n') return end - 1 > from && data[end - 2] == '\r' ? 2 : 1;
+    if(partialCR && end > from && data[end - 1] == '\r') return 1;
+    return 0;
+}
+
+void LineIndexer::readStream(int fd) {
+    size_t pos = 0, from = 0;
+    pollfd pfd = {fd, POLLIN, 0};
+    while(!stopping) {
+        // wake up now and then to notice stop() while the input is idle
+        int ready = poll(&pfd, 1, 100);
+        if(ready == 0 || (ready < 0 && errno == EINTR)) continue;
+        if(ready < 0) break;
+        if(pos == regionSize) {
+            overflow = true;
+            break;
+        }
+
+        ssize_t n = read(fd, region + pos, min(regionSize - pos, READ_BLOCK));
+        if(n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if(n <= 0) break;
+        pos += n;
+        loaded = pos;
+
+        // Hand over what has arrived once a chunk is full or the input goes
+        // quiet. A trailing line break is held back until more input shows it
+        // isn't the final one.
+        if(pos - from < CHUNK && poll(&pfd, 1, 0) > 0) continue;
+        size_t end = pos - trailingBreak(region, from, pos, true);
+        if(end > from) {
+            publish(from, end);
+            from = end;
+        }
+    }
+
+    size_t end = pos - trailingBreak(region, from, pos, false);
+    if(end > from && !stopping) publish(from, end);
+    close(fd);
+    {
+        lock_guard<mutex> lk(lock);
+        complete = true;
+    }
+    chunkDone.notify_all();
+    wake();
+}
+
+void LineIndexer::publish(size_t start, size_t end) {
+    vector<size_t> breaks;
+    scanLineBreaks(base, start, end, breaks);
+    {
+        lock_guard<mutex> lk(lock);
+        chunks.emplace_back();
+        Chunk& c = chunks.back();
+        c.start = start;
+        c.end = end;
+        c.breaks.swap(breaks);
+        c.state = DONE;
+        published++;
+        finished++;
+    }
+    chunkDone.notify_all();
+    wake();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Loads and indexes the line breaks of a file in the background, as a series
+// of chunks that the owner takes back in file order and stitches onto its own
+// offset table. Offsets are absolute, so the stitch is a plain append and the
+// running size of the table is the prefix sum of the per-chunk line counts.
+//
+// A mapped file is cut into CHUNK-sized pieces that a pool of worker threads
+// scans in parallel. Input that can't be mapped (pipes, devices) is read by a
+// single thread into reserved memory and published chunk by chunk as it
+// arrives; a line break at the very end of such input is dropped, matching the
+// implied final line break of mapped files. Until the input ends, the break at
+// the end of what has arrived is held back, so every chunk of a stream ends
+// where the document may end and the owner can take in all of it.
+class LineIndexer {
+    public:
+        static constexpr size_t CHUNK = 8 << 20;
+
+        LineIndexer() {}
+        ~LineIndexer();
+        LineIndexer(const LineIndexer&) = delete;
+        LineIndexer& operator=(const LineIndexer&) = delete;
+
+        void start(const char* data, size_t size);
+        bool startStream(int fd, size_t expected); // takes ownership of fd; expected may be 0 if unknown
+        void stop();
+        // An eventfd to write to whenever a chunk is ready or the input ends,
+        // so the owner's event loop can wake up instead of polling; -1 for none
+        void setWakeup(int fd) { wakeFd = fd; }
+
+        // Appends the breaks of the next chunk in order. Without wait, only a
+        // chunk that is already scanned is taken; with wait, a chunk of a
+        // mapped file is scanned on the calling thread if no worker has
+        // claimed it yet. Never waits for input that hasn't been read.
+        bool take(vector<size_t>& breaks, bool wait);
+        bool done() const { return complete && taken == published; }
+        bool streamed() const { return region != nullptr; } // read from a descriptor rather than mapped
+        const char* data() const { return base; }
+        size_t takenEnd() const { return takenTo; } // bytes covered by taken chunks
+        size_t loadedBytes() const { return loaded; }
+        bool truncated() const { return overflow; } // the input didn't fit in the reserved memory
+        double progress() const; // negative if the total size is unknown
+
+    private:
+        enum State { PENDING, RUNNING, DONE };
+        struct Chunk {
+            atomic<int> state{PENDING};
+            size_t start = 0, end = 0;
+            vector<size_t> breaks;
+        };
+
+        void work();
+        void readStream(int fd);
+        void publish(size_t start, size_t end);
+        void scanChunk(Chunk& c);
+        void wake();
+
+        const char* base = nullptr;
+        size_t expectedSize = 0;
+        char* region = nullptr; // reserved memory for streamed input
+        size_t regionSize = 0;
+        deque<Chunk> chunks;    // guarded by lock while a stream is growing it
+        size_t taken = 0, takenTo = 0;
+        atomic<size_t> next{0};
+        atomic<size_t> published{0};
+        atomic<size_t> finished{0};
+        atomic<size_t> loaded{0};
+        atomic<bool> complete{true};
+        atomic<bool> overflow{false};
+        atomic<bool> stopping{false};
+        int wakeFd = -1;
+        mutex lock;
+        condition_variable chunkDone;
+        vector<thread> workers;
+};
@@ -0,0 +1,91 @@
+#include "linescan.h"
+#include <cstring>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEDIT_X86_SIMD
+#endif
+using namespace std;
+
+// Appends the breaks of one 64-byte block; bit i of mask is byte base + i.
+static inline void emitBreaks(uint64_t mask, size_t base, vector<size_t>& breaks) {
+    while(mask) {
+        breaks.push_back(base + __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+}
+
+static void scanScalar(const char* data, size_t from, size_t to, vector<size_t>& breaks) {
+    const char* p = data + from;
+    const char* end = data + to;
+    while((p = (const char*)memchr(p, '\n', end - p))) {
+        breaks.push_back(p - data);
+        p++;
+    }
+}
+
+#ifdef TEDIT_X86_SIMD
+__attribute__((target("sse2")))
+static void scanSse2(const char* data, size_t from, size_t to, vector<size_t>& breaks) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = from;
+    for(; i + 64 <= to; i += 64) {
+        const __m128i* p = (const __m128i*)(data + i);
+        uint64_t m0 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p), nl));
+        uint64_t m1 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), nl));
+        uint64_t m2 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), nl));
+        uint64_t m3 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), nl));
+        emitBreaks(m0 | (m1 << 16) | (m2 << 32) | (m3 << 48), i, breaks);
+    }
+    scanScalar(data, i, to, breaks);
+}
+
+__attribute__((target("avx2")))
+static void scanAvx2(const char* data, size_t from, size_t to, vector<size_t>& breaks) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = from;
+    for(; i + 64 <= to; i += 64) {
+        const __m256i* p = (const __m256i*)(data + i);
+        uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p), nl));
+        uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p + 1), nl));
+        emitBreaks(lo | (hi << 32), i, breaks);
+    }
+    scanScalar(data, i, to, breaks);
+}
+
+__attribute__((target("avx512bw")))
+static void scanAvx512(const char* data, size_t from, size_t to, vector<size_t>& breaks) {
+    const __m512i nl = _mm512_set1_epi8('\n');
+    size_t i = from;
+    for(; i + 128 <= to; i += 128) {
+        uint64_t m0 = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), nl);
+        uint64_t m1 = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i + 64), nl);
+        if(!(m0 | m1)) continue; // long lines: skip two blocks at once
+        emitBreaks(m0, i, breaks);
+        emitBreaks(m1, i + 64, breaks);
+    }
+    for(; i + 64 <= to; i += 64) {
+        emitBreaks(_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), nl), i, breaks);
+    }
+    scanScalar(data, i, to, breaks);
+}
+#endif
+
+const vector<LineScanner>& lineScanners() {
+    static const vector<LineScanner> scanners = [] {
+        vector<LineScanner> list{{"scalar", scanScalar}};
+#ifdef TEDIT_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse2")) list.push_back({"sse2", scanSse2});
+        if(__builtin_cpu_supports("avx2")) list.push_back({"avx2", scanAvx2});
+        if(__builtin_cpu_supports("avx512bw")) list.push_back({"avx512bw", scanAvx512});
+#endif
+        return list;
+    }();
+    return scanners;
+}
+
+void scanLineBreaks(const char* data, size_t from, size_t to, vector<size_t>& breaks) {
+    static const LineScanFn best = lineScanners().back().scan;
+    best(data, from, to, breaks);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <vector>
+using namespace std;
+
+// Finds the line breaks in a block of text. A CRLF line ends at the same '\n'
+// as an LF line (the CR is dropped when line lengths are computed), so only
+// '\n' needs to be matched. Blocks are compared 64 bytes at a time with the
+// widest vector unit the CPU supports, chosen once at runtime.
+typedef void (*LineScanFn)(const char* data, size_t from, size_t to, vector<size_t>& breaks);
+
+struct LineScanner {
+    const char* name;
+    LineScanFn scan;
+};
+
+// Appends the offset of every '\n' in data[from, to) to breaks, in order.
+void scanLineBreaks(const char* data, size_t from, size_t to, vector<size_t>& breaks);
+
+// Every implementation this CPU can run, slowest first; the last one is what
+// scanLineBreaks uses.
+const vector<LineScanner>& lineScanners();
@@ -37,7 +37,7 @@ int main(int argc, char* argv[]) {
 
     while(true) {
         editor.refreshScreen();
-        if(!editor.processKeypress()) break;
+        if(!editor.processInput()) break;
     }
     return 0;
 }
@@ -0,0 +1,114 @@
+#include "mappedfile.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+// Live mappings, for the SIGBUS handler to look up without taking a lock
+static const int MAX_MAPPINGS = 8;
+struct Mapping {
+    atomic<const char*> addr{nullptr};
+    atomic<size_t> length{0};
+    atomic<bool> cut{false};
+};
+static Mapping s_mappings[MAX_MAPPINGS];
+static size_t s_pageSize = 4096;
+
+// Zero pages take the place of the mapping from the page `at` is in on
+static bool zeroFrom(Mapping& m, const char* at) {
+    uintptr_t from = (uintptr_t)at & ~(uintptr_t)(s_pageSize - 1);
+    uintptr_t end = ((uintptr_t)m.addr.load() + m.length + s_pageSize - 1) & ~(uintptr_t)(s_pageSize - 1);
+    if(from < end && mmap((void*)from, end - from, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) return false;
+    m.cut = true;
+    return true;
+}
+
+// A read past the end of a file truncated underneath its mapping: the rest of
+// it is zeroed and the read is tried again. Faults anywhere else get the
+// default action.
+static void onBusError(int, siginfo_t* info, void*) {
+    const char* at = (const char*)info->si_addr;
+    for(Mapping& m : s_mappings) {
+        const char* start = m.addr;
+        size_t length = m.length;
+        if(!start || at < start || at >= start + length) continue;
+        if(zeroFrom(m, at)) return;
+        break;
+    }
+    signal(SIGBUS, SIG_DFL); // the faulting read runs again and takes it
+}
+
+static void catchBusErrors() {
+    static bool installed = false;
+    if(installed) return;
+    installed = true;
+    s_pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    struct sigaction sa = {};
+    sa.sa_sigaction = onBusError;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGBUS, &sa, nullptr);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) { // pipes, devices etc. can't be mapped
+        close();
+        return false;
+    }
+
+    if(st.st_size > 0) {
+        int k = 0;
+        while(k < MAX_MAPPINGS && s_mappings[k].addr) k++;
+        if(k == MAX_MAPPINGS) { // nowhere to catch a truncation: read it instead
+            close();
+            return false;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) {
+            close();
+            return false;
+        }
+        addr = (const char*)p;
+        length = st.st_size;
+        catchBusErrors();
+        slot = k;
+        s_mappings[slot].cut = false;
+        s_mappings[slot].length = length;
+        s_mappings[slot].addr = addr;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if(slot >= 0) s_mappings[slot].addr = nullptr;
+    slot = -1;
+    if(addr) munmap((void*)addr, length);
+    addr = nullptr;
+    length = 0;
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+// Also before anything read past the new end, which is zeroed right away: the
+// kernel copying out of the mapping (a write() from it) gets EFAULT, not SIGBUS
+bool MappedFile::truncated() const {
+    if(slot < 0) return false;
+    Mapping& m = s_mappings[slot];
+    struct stat st;
+    if(!m.cut && fstat(fd, &st) == 0 && (size_t)st.st_size < length) zeroFrom(m, addr + st.st_size + s_pageSize - 1);
+    return m.cut;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+using namespace std;
+
+// Read-only private mapping of a whole regular file.
+//
+// The pages are read from the file as they are first touched, so another
+// process truncating the file makes reads past its new end fault with SIGBUS.
+// A handler installed with the first mapping catches those faults on any
+// thread: it maps zero-filled pages over the rest of the mapping, so the part
+// that disappeared reads as NUL bytes instead of killing the editor, and
+// truncated() reports it, as it does a file shorter than its mapping before
+// anything faulted. Text already read into memory stays as it was.
+class MappedFile {
+    public:
+        MappedFile() {}
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const string& path); // false if the file cannot be mapped
+        void close();
+        const char* data() const { return addr; }
+        size_t size() const { return length; }
+        bool truncated() const; // the file was cut short on disk while mapped
+
+    private:
+        const char* addr = nullptr;
+        size_t length = 0;
+        int slot = -1; // where the SIGBUS handler finds this mapping
+        int fd = -1;   // kept open to see the file's size
+};
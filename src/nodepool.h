@@ -0,0 +1,54 @@
+#pragma once
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// Fixed-size object allocator for tree nodes. Objects are bump-allocated from
+// slabs of SLAB at a time, released ones are reused first, and everything goes
+// back to the system in one go when the pool is cleared or destroyed, without
+// visiting the objects.
+template<class T, size_t SLAB = 1024>
+class NodePool {
+    static_assert(is_trivially_destructible<T>::value, "pooled objects are never destroyed one by one");
+    static_assert(sizeof(T) >= sizeof(void*), "released objects hold the free list link");
+
+    public:
+        NodePool() {}
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        T* make() {
+            void* p = freeList;
+            if(p) freeList = *(void**)p;
+            else {
+                if(slabs.empty() || used == SLAB) {
+                    slabs.emplace_back(new Slot[SLAB]);
+                    used = 0;
+                }
+                p = &slabs.back()[used++];
+            }
+            return new(p) T();
+        }
+
+        void release(T* n) {
+            *(void**)n = freeList;
+            freeList = n;
+        }
+
+        void clear() {
+            slabs.clear();
+            freeList = nullptr;
+            used = 0;
+        }
+
+    private:
+        struct Slot {
+            alignas(T) unsigned char raw[sizeof(T)];
+        };
+
+        vector<unique_ptr<Slot[]>> slabs;
+        size_t used = 0; // slots handed out from the last slab
+        void* freeList = nullptr;
+};
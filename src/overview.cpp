@@ -0,0 +1,70 @@
+#include "overview.h"
+#include <algorithm>
+using namespace std;
+
+void Overview::Fields::expand(uint32_t word, size_t out[]) {
+    out[0] = word & LENGTH;
+    int type = (word >> TYPE_SHIFT) & 7;
+    for(int t = 1; t < HL_TYPES; t++) out[t] = type == t;
+    out[HL_TYPES] = (word & MODIFIED) != 0;
+    out[HL_TYPES + 1] = (word & UNSUMMARIZED) != 0;
+}
+
+uint32_t Overview::row(size_t length, bool modified) {
+    return (uint32_t)min(length, (size_t)LENGTH) | (modified ? MODIFIED : 0) | UNSUMMARIZED;
+}
+
+// The sweep keeps its place among the old rows; rows spliced in before it are
+// marked and picked up one by one. Rows added at the end are swept along.
+void Overview::splice(int y, int oldCount, const vector<uint32_t>& rows) {
+    int end = y + oldCount;
+    if(sweep >= end && end < index.rows()) sweep += (int)rows.size() - oldCount;
+    else sweep = min(sweep, y);
+    index.splice(y, oldCount, rows);
+}
+
+int Overview::nextPending() const {
+    if(sweep < rows()) return sweep;
+    if(index.total(HL_TYPES + 1) == 0) return -1;
+    size_t start;
+    return index.find(HL_TYPES + 1, 0, start);
+}
+
+void Overview::summarize(int y, const vector<uint8_t>& types) {
+    size_t counts[HL_TYPES] = {};
+    for(uint8_t t : types) counts[t]++;
+    int type = HL_NORMAL; // the highlighted class with the most bytes, if any
+    for(int t = 1; t < HL_TYPES; t++) {
+        if(counts[t] > 0 && (type == HL_NORMAL || counts[t] > counts[type])) type = t;
+    }
+    uint32_t word = index.get(y);
+    index.set(y, (word & ~(7u << TYPE_SHIFT | UNSUMMARIZED)) | (uint32_t)type << TYPE_SHIFT);
+    if(y == sweep) sweep++;
+}
+
+void Overview::clearModified() {
+    // Only the modified rows are visited, each found through the index
+    while(index.total(HL_TYPES) > 0) {
+        size_t start;
+        int y = index.find(HL_TYPES, 0, start);
+        index.set(y, index.get(y) & ~MODIFIED);
+    }
+}
+
+Overview::Bucket Overview::bucket(int from, int to) const {
+    size_t before[Fields::COUNT], upTo[Fields::COUNT];
+    index.sumsBefore(from, before);
+    index.sumsBefore(to, upTo);
+    Bucket b;
+    b.rows = to - from;
+    b.bytes = upTo[0] - before[0];
+    size_t most = 0;
+    for(int t = 1; t < HL_TYPES; t++) {
+        if(upTo[t] - before[t] > most) {
+            most = upTo[t] - before[t];
+            b.type = t;
+        }
+    }
+    b.modified = upTo[HL_TYPES] > before[HL_TYPES];
+    return b;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "rowindex.h"
+#include "syntax.h"
+using namespace std;
+
+// Summary of every row behind the overview ruler: its length, the token class
+// most of it is highlighted as and whether it was edited. Any run of rows is
+// summed in O(log n) plus a scan of two chunks (see RowIndex), so drawing the
+// ruler costs the same for any document size. Rows start out unsummarized and
+// are filled in from Syntax::updateSyntax as the editor gets to them: in order
+// the first time, then only the rows spliced in since, found through the index.
+class Overview {
+    public:
+        struct Bucket {
+            size_t rows = 0, bytes = 0;
+            uint8_t type = HL_NORMAL; // the token class most rows are made of
+            bool modified = false;
+        };
+
+        void clear() { index.clear(); sweep = 0; }
+        int rows() const { return index.rows(); }
+
+        static uint32_t row(size_t length, bool modified); // an unsummarized row
+        // Rows [y, y + oldCount) were replaced by these (see row())
+        void splice(int y, int oldCount, const vector<uint32_t>& rows);
+        void summarize(int y, const vector<uint8_t>& types);
+        void clearModified(); // after a save
+
+        bool pending() const { return sweep < rows() || index.total(HL_TYPES + 1) > 0; }
+        int nextPending() const; // the next row to summarize, -1 when there is none
+        void restart() { sweep = 0; } // the highlighting rules changed
+
+        Bucket bucket(int from, int to) const; // rows [from, to)
+
+    private:
+        // A row is one word: its length, the class it is made of, and flags
+        static constexpr uint32_t LENGTH = 0xFFFFFF, TYPE_SHIFT = 24, MODIFIED = 1u << 27, UNSUMMARIZED = 1u << 28;
+        struct Fields {
+            // bytes, rows of each class but HL_NORMAL, modified rows, unsummarized rows
+            static constexpr int COUNT = 2 + HL_TYPES;
+            static void expand(uint32_t word, size_t out[]);
+        };
+        RowIndex<Fields> index;
+        int sweep = 0; // rows from here on haven't been summarized yet
+};
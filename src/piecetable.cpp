@@ -0,0 +1,375 @@
+#include "piecetable.h"
+#include "linescan.h"
+#include <algorithm>
+#include <climits>
+using namespace std;
+
+PieceTable::PieceTable() {}
+
+PieceTable::~PieceTable() {}
+
+void PieceTable::load(string text) {
+    reset();
+    Buffer& orig = buffers[ORIGINAL];
+    orig.owned = move(text);
+    orig.data = orig.owned.data();
+    orig.size = orig.owned.size();
+    indexer.start(orig.data, orig.size);
+    indexLines(INT_MAX);
+}
+
+void PieceTable::attach(const char* data, size_t size) {
+    reset();
+    buffers[ORIGINAL].data = data;
+    buffers[ORIGINAL].size = size;
+    indexer.start(data, size);
+}
+
+bool PieceTable::stream(int fd, size_t expected) {
+    reset();
+    if(!indexer.startStream(fd, expected)) return false;
+    buffers[ORIGINAL].data = indexer.data();
+    return true;
+}
+
+void PieceTable::indexLines(int lines) {
+    while(!indexed() && (int)breaksOf(root) < lines && (indexer.take(buffers[ORIGINAL].breaks, true) || indexer.done())) absorbTaken();
+}
+
+bool PieceTable::pollIndex() {
+    bool added = false;
+    while(!indexed() && (indexer.take(buffers[ORIGINAL].breaks, false) || indexer.done())) {
+        absorbTaken();
+        added = true;
+    }
+    return added;
+}
+
+size_t PieceTable::size() const {
+    return lenOf(root);
+}
+
+int PieceTable::lineCount() const {
+    // While a mapped file is indexed, the document ends right after a line
+    // break and the empty line following it is not a real line yet. A stream
+    // ends with the line still coming in.
+    return max(1, (int)breaksOf(root) + (indexed() || indexer.streamed() ? 1 : 0));
+}
+
+size_t PieceTable::lineStart(int y) const {
+    if(y <= 0) return 0;
+    if(y > (int)breaksOf(root)) return size();
+    return breakOffset(y) + 1;
+}
+
+int PieceTable::lineLength(int y) const {
+    if(y < 0 || y > (int)breaksOf(root)) return 0;
+    size_t start = lineStart(y);
+    if(y == (int)breaksOf(root)) return (int)(size() - start);
+
+    size_t end = breakOffset(y + 1);
+    if(end > start && charAt(end - 1) == '\r') end--; // CRLF line ending
+    return (int)(end - start);
+}
+
+string PieceTable::line(int y) const {
+    return substr(lineStart(y), lineLength(y));
+}
+
+string_view PieceTable::lineView(int y, string& scratch, size_t maxLen) const {
+    size_t start = lineStart(y);
+    size_t len = min((size_t)lineLength(y), maxLen);
+    if(const char* p = contiguous(start, len)) return string_view(p, len);
+    scratch = substr(start, len);
+    return scratch;
+}
+
+string PieceTable::substr(size_t offset, size_t len) const {
+    string out;
+    if(offset >= size()) return out;
+    len = min(len, size() - offset);
+    out.reserve(len);
+    collect(root, offset, offset + len, out);
+    return out;
+}
+
+char PieceTable::charAt(size_t offset) const {
+    Node* n = root;
+    while(n) {
+        size_t ll = lenOf(n->left);
+        if(offset < ll) n = n->left;
+        else if(offset < ll + n->len) return buffers[n->buf].data[n->start + offset - ll];
+        else {
+            offset -= ll + n->len;
+            n = n->right;
+        }
+    }
+    return '\0';
+}
+
+int PieceTable::lineOf(size_t offset) const {
+    size_t breaks = 0;
+    Node* n = root;
+    while(n) {
+        size_t ll = lenOf(n->left);
+        if(offset < ll) {
+            n = n->left;
+            continue;
+        }
+        breaks += breaksOf(n->left);
+        if(offset < ll + n->len) {
+            // breaks of this piece that come before the offset
+            const vector<size_t>& all = buffers[n->buf].breaks;
+            auto first = all.begin() + n->firstBreak;
+            breaks += lower_bound(first, first + n->breakCount, n->start + offset - ll) - first;
+            break;
+        }
+        breaks += n->breakCount;
+        offset -= ll + n->len;
+        n = n->right;
+    }
+    return (int)breaks;
+}
+
+void PieceTable::insert(size_t offset, const string& s) {
+    if(s.empty()) return;
+    if(offset > size()) offset = size();
+
+    // Text goes into the last add slab while it fits; a slab is never grown,
+    // so pieces can point into it for good. Large inserts get a slab of their own.
+    if(buffers.size() == 1 || buffers.back().owned.capacity() - buffers.back().size < s.size()) {
+        buffers.emplace_back();
+        buffers.back().owned.reserve(max(ADD_SLAB, s.size()));
+    }
+    Buffer& add = buffers.back();
+    size_t start = add.size;
+    add.owned += s;
+    add.data = add.owned.data();
+    add.size = add.owned.size();
+    scanLineBreaks(add.data, start, add.size, add.breaks);
+
+    // Typing continues the previous insert: grow its piece in place, so a run
+    // of keystrokes stays one piece instead of one piece per key
+    if(growPiece(root, offset, start, s.size())) return;
+
+    Node *l, *r;
+    split(root, offset, l, r);
+    root = merge(merge(l, newNode(buffers.size() - 1, start, s.size())), r);
+}
+
+// Extends the piece that ends at offset by len bytes if it ends exactly where
+// the new text was appended to the last add slab
+bool PieceTable::growPiece(Node* n, size_t offset, size_t start, size_t len) {
+    if(!n) return false;
+    size_t ll = lenOf(n->left);
+    if(offset <= ll) {
+        if(!growPiece(n->left, offset, start, len)) return false;
+    } else if(offset == ll + n->len) {
+        if(n->buf != (int)buffers.size() - 1 || n->start + n->len != start) return false;
+        n->len += len;
+        countBreaks(n);
+    } else if(offset > ll + n->len) {
+        if(!growPiece(n->right, offset - ll - n->len, start, len)) return false;
+    } else return false;
+    update(n);
+    return true;
+}
+
+void PieceTable::erase(size_t offset, size_t len) {
+    if(offset >= size() || len == 0) return;
+    len = min(len, size() - offset);
+
+    Node *l, *m, *r;
+    split(root, offset, l, m);
+    split(m, len, m, r);
+    destroy(m);
+    root = merge(l, r);
+}
+
+void PieceTable::write(ostream& out) const {
+    writeNode(root, out);
+    // the part of the original that has not been indexed yet
+    const Buffer& orig = buffers[ORIGINAL];
+    out.write(orig.data + absorbed, orig.size - absorbed);
+}
+
+void PieceTable::reset() {
+    indexer.stop();
+    nodes.clear();
+    root = nullptr;
+    buffers.assign(1, Buffer());
+    absorbed = 0;
+}
+
+// Only whole lines of a mapped file join the document until its end is reached
+void PieceTable::absorbTaken() {
+    Buffer& orig = buffers[ORIGINAL];
+    orig.size = max(orig.size, indexer.takenEnd()); // a stream grows as it is read
+    if(indexer.done() || indexer.streamed()) absorb(orig.size); // a stream's chunks end where the document may
+    else if(!orig.breaks.empty() && orig.breaks.back() >= absorbed) absorb(orig.breaks.back() + 1);
+}
+
+// Appends original bytes [absorbed, upTo) to the end of the document.
+void PieceTable::absorb(size_t upTo) {
+    if(upTo <= absorbed) return;
+    Node* last = root;
+    while(last && last->right) last = last->right;
+
+    if(last && last->buf == ORIGINAL && last->start + last->len == absorbed) extendLast(root, upTo - absorbed);
+    else root = merge(root, newNode(ORIGINAL, absorbed, upTo - absorbed));
+    absorbed = upTo;
+}
+
+void PieceTable::extendLast(Node* n, size_t len) {
+    if(n->right) extendLast(n->right, len);
+    else {
+        n->len += len;
+        countBreaks(n);
+    }
+    update(n);
+}
+
+PieceTable::Node* PieceTable::newNode(int buf, size_t start, size_t len) {
+    // xorshift32 keeps the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node* n = nodes.make();
+    n->buf = buf;
+    n->start = start;
+    n->len = len;
+    n->priority = seed;
+    countBreaks(n);
+    update(n);
+    return n;
+}
+
+void PieceTable::countBreaks(Node* n) {
+    const vector<size_t>& breaks = buffers[n->buf].breaks;
+    auto first = lower_bound(breaks.begin(), breaks.end(), n->start);
+    auto last = lower_bound(first, breaks.end(), n->start + n->len);
+    n->firstBreak = first - breaks.begin();
+    n->breakCount = last - first;
+}
+
+void PieceTable::update(Node* n) {
+    n->sumLen = lenOf(n->left) + n->len + lenOf(n->right);
+    n->sumBreaks = breaksOf(n->left) + n->breakCount + breaksOf(n->right);
+}
+
+PieceTable::Node* PieceTable::merge(Node* a, Node* b) {
+    if(!a) return b;
+    if(!b) return a;
+    if(a->priority > b->priority) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+void PieceTable::split(Node* t, size_t offset, Node*& l, Node*& r) {
+    if(!t) {
+        l = r = nullptr;
+        return;
+    }
+
+    size_t ll = lenOf(t->left);
+    if(offset <= ll) {
+        split(t->left, offset, l, t->left);
+        update(t);
+        r = t;
+    } else if(offset >= ll + t->len) {
+        split(t->right, offset - ll - t->len, t->right, r);
+        update(t);
+        l = t;
+    } else {
+        // Offset falls inside this piece: cut it in two. Both halves keep the
+        // old priority, so each remains a valid treap with its own subtree.
+        size_t k = offset - ll;
+        Node* tail = newNode(t->buf, t->start + k, t->len - k);
+        tail->priority = t->priority;
+        tail->right = t->right;
+        update(tail);
+
+        t->right = nullptr;
+        t->len = k;
+        countBreaks(t);
+        update(t);
+
+        l = t;
+        r = tail;
+    }
+}
+
+void PieceTable::destroy(Node* n) {
+    if(!n) return;
+    destroy(n->left);
+    destroy(n->right);
+    nodes.release(n);
+}
+
+size_t PieceTable::breakOffset(size_t k) const {
+    Node* n = root;
+    size_t base = 0;
+    while(n) {
+        size_t lb = breaksOf(n->left);
+        if(k <= lb) {
+            n = n->left;
+            continue;
+        }
+        k -= lb;
+        base += lenOf(n->left);
+        if(k <= n->breakCount) {
+            size_t pos = buffers[n->buf].breaks[n->firstBreak + k - 1];
+            return base + (pos - n->start);
+        }
+        k -= n->breakCount;
+        base += n->len;
+        n = n->right;
+    }
+    return size();
+}
+
+// Where the bytes [offset, offset + len) are stored, if they lie within one piece
+const char* PieceTable::contiguous(size_t offset, size_t len) const {
+    if(len == 0) return "";
+    Node* n = root;
+    while(n) {
+        size_t ll = lenOf(n->left);
+        if(offset < ll) n = n->left;
+        else if(offset < ll + n->len) {
+            size_t at = offset - ll;
+            return at + len <= n->len ? buffers[n->buf].data + n->start + at : nullptr;
+        } else {
+            offset -= ll + n->len;
+            n = n->right;
+        }
+    }
+    return nullptr;
+}
+
+void PieceTable::collect(Node* n, size_t from, size_t to, string& out) const {
+    if(!n || from >= to) return;
+    size_t ll = lenOf(n->left);
+    if(from < ll) collect(n->left, from, min(to, ll), out);
+
+    size_t pieceEnd = ll + n->len;
+    if(to > ll && from < pieceEnd) {
+        size_t a = max(from, ll) - ll;
+        size_t b = min(to, pieceEnd) - ll;
+        out.append(buffers[n->buf].data + n->start + a, b - a);
+    }
+
+    if(to > pieceEnd) collect(n->right, from > pieceEnd ? from - pieceEnd : 0, to - pieceEnd, out);
+}
+
+void PieceTable::writeNode(Node* n, ostream& out) const {
+    if(!n) return;
+    writeNode(n->left, out);
+    out.write(buffers[n->buf].data + n->start, n->len);
+    writeNode(n->right, out);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <deque>
+#include "lineindexer.h"
+#include "nodepool.h"
+using namespace std;
+
+// Text storage for the editor. The document is a sequence of pieces, each one a
+// slice of either the original file contents or one of the append-only add
+// slabs. Pieces are kept in a treap ordered by document position and every node
+// caches the byte and line-break totals of its subtree, so edits and line/offset
+// lookups cost O(log pieces) regardless of the document size. Nodes come from a
+// slab pool and typed text is bump-allocated into fixed-capacity slabs that
+// never move, so both are freed in bulk rather than piece by piece.
+//
+// The original contents can also be attached without copying (e.g. a read-only
+// file mapping). Its line breaks are then indexed in the background by a
+// LineIndexer: only the whole lines indexed so far (or explicitly asked for
+// with indexLines) are part of the document, so lineCount() reports complete
+// lines only until the whole file is indexed. Input that can't be mapped is
+// streamed in from a file descriptor the same way, as the background reader
+// delivers it, except that all of it is part of the document as soon as it is
+// taken: the line still coming in shows as a provisional last line.
+class PieceTable {
+    public:
+        PieceTable();
+        ~PieceTable();
+        PieceTable(const PieceTable&) = delete;
+        PieceTable& operator=(const PieceTable&) = delete;
+
+        void load(string text);
+        void attach(const char* data, size_t size); // data must outlive the table
+        bool stream(int fd, size_t expected); // takes ownership of fd
+        void indexLines(int lines); // make at least `lines` lines available
+        bool pollIndex(); // take in lines indexed in the background; true if any were added
+        void setWakeup(int fd) { indexer.setWakeup(fd); } // an eventfd written to when pollIndex() has more to take
+        bool indexed() const { return indexer.done() && absorbed == buffers[ORIGINAL].size; }
+        bool streaming() const { return indexer.streamed() && !indexer.done(); } // more input may still arrive
+        double loadProgress() const { return indexed() ? 1.0 : indexer.progress(); }
+        size_t pendingBytes() const { return buffers[ORIGINAL].size - absorbed; } // known bytes not in the document yet
+        size_t loadedBytes() const { return indexer.loadedBytes(); }
+        bool truncated() const { return indexer.truncated(); }
+
+        size_t size() const;
+        int lineCount() const;
+        size_t lineStart(int y) const;
+        int lineLength(int y) const; // excludes the line break (and a CR before it)
+        int lineOf(size_t offset) const;
+        string line(int y) const;
+        // Up to maxLen bytes of line y; points into the table unless they span pieces
+        string_view lineView(int y, string& scratch, size_t maxLen = SIZE_MAX) const;
+        string substr(size_t offset, size_t len) const;
+        char charAt(size_t offset) const;
+
+        void insert(size_t offset, const string& s);
+        void erase(size_t offset, size_t len);
+        void write(ostream& out) const;
+
+    private:
+        enum { ORIGINAL = 0 }; // add slabs follow it
+        static constexpr size_t ADD_SLAB = 64 << 10;
+        struct Buffer {
+            const char* data = nullptr;
+            size_t size = 0;
+            string owned;          // backing storage unless the data is attached
+            vector<size_t> breaks; // offsets of every '\n' scanned so far
+        };
+        struct Node {
+            int buf;
+            size_t start, len;
+            size_t firstBreak, breakCount; // slice of buffers[buf].breaks inside this piece
+            uint32_t priority;
+            Node* left = nullptr;
+            Node* right = nullptr;
+            size_t sumLen = 0, sumBreaks = 0; // totals of the whole subtree
+        };
+
+        Node* newNode(int buf, size_t start, size_t len);
+        void countBreaks(Node* n);
+        static void update(Node* n);
+        static size_t lenOf(Node* n) { return n ? n->sumLen : 0; }
+        static size_t breaksOf(Node* n) { return n ? n->sumBreaks : 0; }
+        Node* merge(Node* a, Node* b);
+        void split(Node* t, size_t offset, Node*& l, Node*& r);
+        bool growPiece(Node* n, size_t offset, size_t start, size_t len);
+        void destroy(Node* n);
+        size_t breakOffset(size_t k) const; // document offset of the k-th (1-based) '\n'
+        const char* contiguous(size_t offset, size_t len) const;
+        void collect(Node* n, size_t from, size_t to, string& out) const;
+        void writeNode(Node* n, ostream& out) const;
+        void reset();
+        void absorb(size_t upTo);
+        void absorbTaken();
+        void extendLast(Node* n, size_t len);
+
+        deque<Buffer> buffers = deque<Buffer>(1); // growing a deque never moves a buffer
+        NodePool<Node> nodes;
+        Node* root = nullptr;
+        LineIndexer indexer;
+        size_t absorbed = 0; // original bytes that are part of the document
+        uint32_t seed = 2463534242u;
+};
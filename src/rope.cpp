@@ -0,0 +1,382 @@
+#include "rope.h"
+#include <algorithm>
+using namespace std;
+
+Rope::Rope() : root(new Node) {}
+
+Rope::~Rope() {
+    destroy(root);
+}
+
+void Rope::load(string text) {
+    indexer.stop();
+    destroy(root);
+    source = nullptr;
+    sourceSize = absorbed = 0;
+
+    vector<Node*> level;
+    for(size_t pos = 0; pos < text.size(); pos += MAX_LEAF) {
+        Node* leaf = new Node;
+        leaf->text = text.substr(pos, MAX_LEAF);
+        recount(leaf);
+        level.push_back(leaf);
+    }
+    if(level.empty()) level.push_back(new Node);
+    while(level.size() > 1) level = buildLevel(level);
+    root = level[0];
+}
+
+void Rope::attach(const char* data, size_t size) {
+    load("");
+    source = data;
+    sourceSize = size;
+    indexer.start(data, size);
+}
+
+bool Rope::stream(int fd, size_t expected) {
+    load("");
+    if(!indexer.startStream(fd, expected)) return false;
+    source = indexer.data();
+    return true;
+}
+
+void Rope::indexLines(int lines) {
+    vector<size_t> breaks;
+    while(!indexed() && (int)root->breaks < lines && (indexer.take(breaks, true) || indexer.done())) {
+        absorbTaken(breaks);
+        breaks.clear();
+    }
+}
+
+bool Rope::pollIndex() {
+    bool added = false;
+    vector<size_t> breaks;
+    while(!indexed() && (indexer.take(breaks, false) || indexer.done())) {
+        absorbTaken(breaks);
+        breaks.clear();
+        added = true;
+    }
+    return added;
+}
+
+// Copies in whole lines of attached contents only, up to the last break of the
+// chunk just taken; a stream's chunks end where the document may, so all of it
+void Rope::absorbTaken(const vector<size_t>& breaks) {
+    sourceSize = max(sourceSize, indexer.takenEnd()); // a stream grows as it is read
+    size_t upTo = absorbed;
+    if(indexer.done() || indexer.streamed()) upTo = sourceSize;
+    else if(!breaks.empty()) upTo = breaks.back() + 1;
+    if(upTo <= absorbed) return;
+    insert(size(), string(source + absorbed, upTo - absorbed));
+    absorbed = upTo;
+}
+
+size_t Rope::size() const {
+    return root->bytes;
+}
+
+int Rope::lineCount() const {
+    // While attached contents are indexed, the document ends right after a
+    // line break and the empty line following it is not a real line yet. A
+    // stream ends with the line still coming in.
+    return max(1, (int)root->breaks + (indexed() || indexer.streamed() ? 1 : 0));
+}
+
+size_t Rope::lineStart(int y) const {
+    if(y <= 0) return 0;
+    if(y > (int)root->breaks) return size();
+    return breakOffset(y) + 1;
+}
+
+int Rope::lineLength(int y) const {
+    if(y < 0 || y > (int)root->breaks) return 0;
+    size_t start = lineStart(y);
+    if(y == (int)root->breaks) return (int)(size() - start);
+
+    size_t end = breakOffset(y + 1);
+    if(end > start && charAt(end - 1) == '\r') end--; // CRLF line ending
+    return (int)(end - start);
+}
+
+string Rope::line(int y) const {
+    return substr(lineStart(y), lineLength(y));
+}
+
+string_view Rope::lineView(int y, string& scratch, size_t maxLen) const {
+    size_t start = lineStart(y);
+    size_t len = min((size_t)lineLength(y), maxLen);
+    if(const char* p = contiguous(start, len)) return string_view(p, len);
+    scratch = substr(start, len);
+    return scratch;
+}
+
+string Rope::substr(size_t offset, size_t len) const {
+    string out;
+    if(offset >= size()) return out;
+    len = min(len, size() - offset);
+    out.reserve(len);
+    collect(root, offset, offset + len, out);
+    return out;
+}
+
+char Rope::charAt(size_t offset) const {
+    if(offset >= size()) return '\0';
+    const Node* n = root;
+    while(!n->leaf) {
+        for(const Node* c : n->children) {
+            if(offset < c->bytes) {
+                n = c;
+                break;
+            }
+            offset -= c->bytes;
+        }
+    }
+    return n->text[offset];
+}
+
+int Rope::lineOf(size_t offset) const {
+    if(offset >= size()) return (int)root->breaks;
+    const Node* n = root;
+    size_t breaks = 0;
+    while(!n->leaf) {
+        for(const Node* c : n->children) {
+            if(offset < c->bytes) {
+                n = c;
+                break;
+            }
+            offset -= c->bytes;
+            breaks += c->breaks;
+        }
+    }
+    return (int)(breaks + count(n->text.begin(), n->text.begin() + offset, '\n'));
+}
+
+void Rope::insert(size_t offset, const string& s) {
+    if(s.empty()) return;
+    if(offset > size()) offset = size();
+
+    vector<Node*> extra = insertAt(root, offset, s);
+    if(extra.empty()) return;
+
+    // Root overflowed: grow the tree by one (or more) levels
+    vector<Node*> level{root};
+    level.insert(level.end(), extra.begin(), extra.end());
+    while(level.size() > 1) level = buildLevel(level);
+    root = level[0];
+}
+
+void Rope::erase(size_t offset, size_t len) {
+    if(offset >= size() || len == 0) return;
+    len = min(len, size() - offset);
+
+    eraseRange(root, offset, offset + len);
+    while(!root->leaf && root->children.size() == 1) {
+        Node* child = root->children[0];
+        root->children.clear();
+        delete root;
+        root = child;
+    }
+    if(!root->leaf && root->children.empty()) {
+        root->leaf = true;
+        recount(root);
+    }
+}
+
+void Rope::write(ostream& out) const {
+    writeNode(root, out);
+    if(source) out.write(source + absorbed, sourceSize - absorbed); // not indexed yet
+}
+
+void Rope::recount(Node* n) {
+    if(n->leaf) {
+        n->bytes = n->text.size();
+        n->breaks = count(n->text.begin(), n->text.end(), '\n');
+        return;
+    }
+    n->bytes = n->breaks = 0;
+    for(const Node* c : n->children) {
+        n->bytes += c->bytes;
+        n->breaks += c->breaks;
+    }
+}
+
+bool Rope::underfull(const Node* n) {
+    return n->leaf ? n->text.size() < MIN_LEAF : n->children.size() < MIN_CHILDREN;
+}
+
+// Groups nodes of one level under as few evenly filled parents as possible.
+vector<Rope::Node*> Rope::buildLevel(vector<Node*>& nodes) {
+    size_t groups = (nodes.size() + MAX_CHILDREN - 1) / MAX_CHILDREN;
+    size_t per = (nodes.size() + groups - 1) / groups;
+
+    vector<Node*> parents;
+    for(size_t i = 0; i < nodes.size(); i += per) {
+        Node* p = new Node;
+        p->leaf = false;
+        p->children.assign(nodes.begin() + i, nodes.begin() + min(nodes.size(), i + per));
+        recount(p);
+        parents.push_back(p);
+    }
+    return parents;
+}
+
+// Splits a node that grew past its limit into evenly sized siblings. n keeps
+// the first part; the new right siblings are returned in order.
+vector<Rope::Node*> Rope::splitOverfull(Node* n) {
+    vector<Node*> extra;
+    size_t total = n->leaf ? n->text.size() : n->children.size();
+    size_t limit = n->leaf ? MAX_LEAF : MAX_CHILDREN;
+    if(total <= limit) return extra;
+
+    size_t parts = (total + limit - 1) / limit;
+    size_t per = (total + parts - 1) / parts;
+    for(size_t i = per; i < total; i += per) {
+        Node* s = new Node;
+        s->leaf = n->leaf;
+        if(n->leaf) s->text = n->text.substr(i, per);
+        else s->children.assign(n->children.begin() + i, n->children.begin() + min(total, i + per));
+        recount(s);
+        extra.push_back(s);
+    }
+    if(n->leaf) n->text.resize(per);
+    else n->children.resize(per);
+    recount(n);
+    return extra;
+}
+
+void Rope::destroy(Node* n) {
+    for(Node* c : n->children) destroy(c);
+    delete n;
+}
+
+vector<Rope::Node*> Rope::insertAt(Node* n, size_t offset, const string& s) {
+    if(n->leaf) {
+        n->text.insert(offset, s);
+        recount(n);
+        return splitOverfull(n);
+    }
+
+    size_t i = 0;
+    while(i + 1 < n->children.size() && offset > n->children[i]->bytes) {
+        offset -= n->children[i]->bytes;
+        i++;
+    }
+    vector<Node*> extra = insertAt(n->children[i], offset, s);
+    n->children.insert(n->children.begin() + i + 1, extra.begin(), extra.end());
+    recount(n);
+    return splitOverfull(n);
+}
+
+void Rope::eraseRange(Node* n, size_t from, size_t to) {
+    if(n->leaf) {
+        n->text.erase(from, to - from);
+        recount(n);
+        return;
+    }
+
+    size_t pos = 0;
+    for(size_t i = 0; i < n->children.size() && pos < to;) {
+        Node* c = n->children[i];
+        size_t start = pos, end = pos + c->bytes;
+        pos = end;
+        if(end <= from) {
+            i++;
+        } else if(from <= start && to >= end) {
+            // child lies entirely inside the range
+            destroy(c);
+            n->children.erase(n->children.begin() + i);
+        } else {
+            eraseRange(c, max(from, start) - start, min(to, end) - start);
+            i++;
+        }
+    }
+
+    for(size_t i = 0; i < n->children.size();) {
+        if(n->children.size() > 1 && underfull(n->children[i])) i = mergeChildren(n, i);
+        else i++;
+    }
+    recount(n);
+}
+
+// Merges child i with a neighbour, re-splitting if the result is too large.
+// Returns the index of the merged child.
+size_t Rope::mergeChildren(Node* n, size_t i) {
+    size_t a = (i + 1 < n->children.size()) ? i : i - 1;
+    Node* left = n->children[a];
+    Node* right = n->children[a + 1];
+
+    if(left->leaf) left->text += right->text;
+    else left->children.insert(left->children.end(), right->children.begin(), right->children.end());
+    right->children.clear();
+    destroy(right);
+    n->children.erase(n->children.begin() + a + 1);
+
+    recount(left);
+    vector<Node*> extra = splitOverfull(left);
+    n->children.insert(n->children.begin() + a + 1, extra.begin(), extra.end());
+    return a;
+}
+
+// Where the bytes [offset, offset + len) are stored, if they lie within one leaf
+const char* Rope::contiguous(size_t offset, size_t len) const {
+    if(len == 0) return "";
+    if(offset + len > size()) return nullptr;
+    const Node* n = root;
+    while(!n->leaf) {
+        for(const Node* c : n->children) {
+            if(offset < c->bytes) {
+                n = c;
+                break;
+            }
+            offset -= c->bytes;
+        }
+    }
+    return offset + len <= n->text.size() ? n->text.data() + offset : nullptr;
+}
+
+size_t Rope::breakOffset(size_t k) const {
+    const Node* n = root;
+    size_t base = 0;
+    while(!n->leaf) {
+        const Node* next = nullptr;
+        for(const Node* c : n->children) {
+            if(k <= c->breaks) {
+                next = c;
+                break;
+            }
+            k -= c->breaks;
+            base += c->bytes;
+        }
+        if(!next) return size();
+        n = next;
+    }
+
+    for(size_t i = 0; i < n->text.size(); i++) {
+        if(n->text[i] == '\n' && --k == 0) return base + i;
+    }
+    return size();
+}
+
+void Rope::collect(const Node* n, size_t from, size_t to, string& out) const {
+    if(n->leaf) {
+        out.append(n->text, from, to - from);
+        return;
+    }
+
+    size_t pos = 0;
+    for(const Node* c : n->children) {
+        size_t start = pos, end = pos + c->bytes;
+        pos = end;
+        if(end <= from) continue;
+        if(start >= to) break;
+        collect(c, max(from, start) - start, min(to, end) - start, out);
+    }
+}
+
+void Rope::writeNode(const Node* n, ostream& out) const {
+    if(n->leaf) {
+        out.write(n->text.data(), n->text.size());
+        return;
+    }
+    for(const Node* c : n->children) writeNode(c, out);
+}
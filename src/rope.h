@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include "lineindexer.h"
+using namespace std;
+
+// Alternative text storage: a B-tree of text chunks. Leaves hold up to
+// MAX_LEAF bytes, and every node caches the byte and line-break totals of its
+// subtree, so line -> offset and offset -> line lookups as well as inserts and
+// deletes anywhere in the document cost O(log n). Exposes the same interface as
+// PieceTable so either can sit behind the editor (see buffer.h); attached or
+// streamed contents are copied into chunks as their lines get indexed.
+class Rope {
+    public:
+        Rope();
+        ~Rope();
+        Rope(const Rope&) = delete;
+        Rope& operator=(const Rope&) = delete;
+
+        void load(string text);
+        void attach(const char* data, size_t size); // data must outlive the rope
+        bool stream(int fd, size_t expected); // takes ownership of fd
+        void indexLines(int lines); // make at least `lines` lines available
+        bool pollIndex(); // take in lines indexed in the background; true if any were added
+        void setWakeup(int fd) { indexer.setWakeup(fd); } // an eventfd written to when pollIndex() has more to take
+        bool indexed() const { return indexer.done() && absorbed == sourceSize; }
+        bool streaming() const { return indexer.streamed() && !indexer.done(); } // more input may still arrive
+        double loadProgress() const { return indexed() ? 1.0 : indexer.progress(); }
+        size_t pendingBytes() const { return sourceSize - absorbed; } // known bytes not in the document yet
+        size_t loadedBytes() const { return indexer.loadedBytes(); }
+        bool truncated() const { return indexer.truncated(); }
+
+        size_t size() const;
+        int lineCount() const;
+        size_t lineStart(int y) const;
+        int lineLength(int y) const; // excludes the line break (and a CR before it)
+        int lineOf(size_t offset) const;
+        string line(int y) const;
+        // Up to maxLen bytes of line y; points into the rope unless they span leaves
+        string_view lineView(int y, string& scratch, size_t maxLen = SIZE_MAX) const;
+        string substr(size_t offset, size_t len) const;
+        char charAt(size_t offset) const;
+
+        void insert(size_t offset, const string& s);
+        void erase(size_t offset, size_t len);
+        void write(ostream& out) const;
+
+    private:
+        static constexpr size_t MAX_LEAF = 2048, MIN_LEAF = 512;
+        static constexpr size_t MAX_CHILDREN = 16, MIN_CHILDREN = 4;
+
+        struct Node {
+            bool leaf = true;
+            size_t bytes = 0, breaks = 0; // totals of the whole subtree
+            string text;                  // leaf only
+            vector<Node*> children;       // internal only
+        };
+
+        static void recount(Node* n);
+        static bool underfull(const Node* n);
+        static vector<Node*> buildLevel(vector<Node*>& nodes);
+        static vector<Node*> splitOverfull(Node* n);
+        static void destroy(Node* n);
+        vector<Node*> insertAt(Node* n, size_t offset, const string& s);
+        void eraseRange(Node* n, size_t from, size_t to);
+        size_t mergeChildren(Node* n, size_t i);
+        size_t breakOffset(size_t k) const; // document offset of the k-th (1-based) '\n'
+        const char* contiguous(size_t offset, size_t len) const;
+        void collect(const Node* n, size_t from, size_t to, string& out) const;
+        void writeNode(const Node* n, ostream& out) const;
+        void absorbTaken(const vector<size_t>& breaks);
+
+        Node* root;
+        const char* source = nullptr; // attached contents, indexed lazily
+        size_t sourceSize = 0;
+        size_t absorbed = 0; // source bytes that are part of the document
+        LineIndexer indexer;
+};
@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+using namespace std;
+
+// One 32-bit word for every row of the document, kept in chunks of up to
+// MAX_CHUNK rows with a Fenwick tree per summed field over the chunk totals.
+// Fields::COUNT quantities are summed; Fields::expand(word, out) gives a row's
+// share of each. Running totals up to a row, finding the row a running total
+// reaches and changing a row cost O(log n) plus a scan of one chunk.
+// Inserting or removing rows only rewrites the chunks they fall in; the trees
+// are rebuilt when chunks split or go away.
+template<class Fields>
+class RowIndex {
+    public:
+        static constexpr int COUNT = Fields::COUNT;
+
+        RowIndex() { rebuild(); }
+
+        void clear() {
+            chunks.clear();
+            rowCount = 0;
+            fill(totals, totals + COUNT, 0);
+            rebuild();
+        }
+        int rows() const { return rowCount; }
+        size_t total(int field) const { return totals[field]; }
+
+        // Rows [y, y + oldCount) were replaced by rows with these words
+        void splice(int y, int oldCount, const vector<uint32_t>& words) {
+            if(chunks.empty()) {
+                chunks.emplace_back();
+                rebuild();
+            }
+
+            // The chunks holding the replaced rows are cut up again, with the new
+            // rows in place of the old ones (rows added at the end go into the last chunk)
+            size_t from = y, to = y + oldCount;
+            size_t first = search(rowTree, from), last = search(rowTree, to);
+            if(first == chunks.size()) from = chunks[--first].words.size();
+            if(last == chunks.size()) to = chunks[--last].words.size();
+            vector<uint32_t> merged(chunks[first].words.begin(), chunks[first].words.begin() + from);
+            merged.insert(merged.end(), words.begin(), words.end());
+            merged.insert(merged.end(), chunks[last].words.begin() + to, chunks[last].words.end());
+            if(merged.size() < MAX_CHUNK / 4 && last + 1 < chunks.size()) { // keep chunks from dwindling away
+                last++;
+                merged.insert(merged.end(), chunks[last].words.begin(), chunks[last].words.end());
+            }
+
+            size_t n = merged.size(), parts = (n + MAX_CHUNK - 1) / MAX_CHUNK;
+            vector<Chunk> pieces(parts);
+            for(size_t p = 0; p < parts; p++) {
+                pieces[p].words.assign(merged.begin() + n * p / parts, merged.begin() + n * (p + 1) / parts);
+                for(uint32_t w : pieces[p].words) addWord(pieces[p].sums, w);
+            }
+
+            rowCount += (int)words.size() - oldCount;
+            for(size_t c = first; c <= last; c++) {
+                for(int f = 0; f < COUNT; f++) totals[f] -= chunks[c].sums[f];
+            }
+            for(const Chunk& p : pieces) {
+                for(int f = 0; f < COUNT; f++) totals[f] += p.sums[f];
+            }
+            if(pieces.size() == last - first + 1) {
+                // Same chunks, different contents: update the trees in place
+                for(size_t p = 0; p < parts; p++) {
+                    Chunk& c = chunks[first + p];
+                    add(rowTree, first + p, pieces[p].words.size() - c.words.size());
+                    for(int f = 0; f < COUNT; f++) add(trees[f], first + p, pieces[p].sums[f] - c.sums[f]);
+                    c = move(pieces[p]);
+                }
+            } else {
+                chunks.erase(chunks.begin() + first, chunks.begin() + last + 1);
+                chunks.insert(chunks.begin() + first, make_move_iterator(pieces.begin()), make_move_iterator(pieces.end()));
+                rebuild();
+            }
+        }
+
+        uint32_t get(int y) const {
+            size_t i = y;
+            size_t c = search(rowTree, i);
+            return c < chunks.size() ? chunks[c].words[i] : 0;
+        }
+
+        void set(int y, uint32_t word) {
+            size_t i = y;
+            size_t c = search(rowTree, i);
+            if(c == chunks.size() || chunks[c].words[i] == word) return;
+            size_t before[COUNT] = {}, after[COUNT] = {};
+            addWord(before, chunks[c].words[i]);
+            addWord(after, word);
+            chunks[c].words[i] = word;
+            for(int f = 0; f < COUNT; f++) {
+                size_t delta = after[f] - before[f]; // wraps around to subtract
+                chunks[c].sums[f] += delta;
+                add(trees[f], c, delta);
+                totals[f] += delta;
+            }
+        }
+
+        // Totals of every field over rows [0, y)
+        void sumsBefore(int y, size_t out[COUNT]) const {
+            size_t i = y;
+            size_t c = search(rowTree, i);
+            for(int f = 0; f < COUNT; f++) out[f] = c < chunks.size() ? prefix(trees[f], c) : totals[f];
+            if(c == chunks.size()) return;
+            for(size_t k = 0; k < i; k++) addWord(out, chunks[c].words[k]);
+        }
+
+        size_t sumBefore(int y, int field) const {
+            size_t i = y;
+            size_t c = search(rowTree, i);
+            if(c == chunks.size()) return totals[field];
+            size_t sum = prefix(trees[field], c), shares[COUNT];
+            for(size_t k = 0; k < i; k++) {
+                Fields::expand(chunks[c].words[k], shares);
+                sum += shares[field];
+            }
+            return sum;
+        }
+
+        // The row in which the running total of field passes pos (the last row
+        // if it never does); start is set to the total before that row
+        int find(int field, size_t pos, size_t& start) const {
+            if(pos >= totals[field]) {
+                int y = max(rowCount - 1, 0);
+                start = sumBefore(y, field);
+                return y;
+            }
+            size_t offset = pos, shares[COUNT];
+            size_t c = search(trees[field], offset);
+            size_t k = 0;
+            while(true) {
+                Fields::expand(chunks[c].words[k], shares);
+                if(offset < shares[field]) break;
+                offset -= shares[field];
+                k++;
+            }
+            start = pos - offset;
+            return (int)(prefix(rowTree, c) + k);
+        }
+
+    private:
+        static constexpr size_t MAX_CHUNK = 512;
+        struct Chunk {
+            vector<uint32_t> words;
+            size_t sums[COUNT] = {};
+        };
+
+        static void addWord(size_t sums[COUNT], uint32_t word) {
+            size_t shares[COUNT];
+            Fields::expand(word, shares);
+            for(int f = 0; f < COUNT; f++) sums[f] += shares[f];
+        }
+
+        // Fenwick tree helpers; deltas wrap around to subtract
+        static void add(vector<size_t>& tree, size_t i, size_t delta) {
+            for(i++; i < tree.size(); i += i & -i) tree[i] += delta;
+        }
+
+        static size_t prefix(const vector<size_t>& tree, size_t i) { // total of entries [0, i)
+            size_t sum = 0;
+            for(; i > 0; i -= i & -i) sum += tree[i];
+            return sum;
+        }
+
+        // The entry covering position pos of the running total (the entry
+        // count past the end); pos becomes the offset into that entry
+        static size_t search(const vector<size_t>& tree, size_t& pos) {
+            size_t n = tree.size() - 1, i = 0, step = 1;
+            while(step * 2 <= n) step *= 2;
+            for(; step > 0; step /= 2) {
+                if(i + step <= n && tree[i + step] <= pos) {
+                    i += step;
+                    pos -= tree[i];
+                }
+            }
+            return i;
+        }
+
+        void rebuild() {
+            size_t n = chunks.size();
+            rowTree.assign(n + 1, 0);
+            for(int f = 0; f < COUNT; f++) trees[f].assign(n + 1, 0);
+            for(size_t i = 1; i <= n; i++) {
+                size_t j = i + (i & -i);
+                rowTree[i] += chunks[i - 1].words.size();
+                if(j <= n) rowTree[j] += rowTree[i];
+                for(int f = 0; f < COUNT; f++) {
+                    trees[f][i] += chunks[i - 1].sums[f];
+                    if(j <= n) trees[f][j] += trees[f][i];
+                }
+            }
+        }
+
+        vector<Chunk> chunks;
+        vector<size_t> rowTree;        // rows in each chunk
+        vector<size_t> trees[COUNT];   // field totals of each chunk
+        size_t totals[COUNT] = {};
+        int rowCount = 0;
+};
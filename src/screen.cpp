@@ -0,0 +1,211 @@
+#include "screen.h"
+#include "unicode.h"
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+static const Screen::Cell BLANK;
+static_assert(sizeof(Screen::Cell) == 16, "cells are compared as plain bytes");
+
+// The cells drawn so far keep their place, so the caller only has to draw what
+// the new size uncovers. The terminal rearranges its contents its own way on a
+// resize, so the next frame is sent whole.
+void Screen::resize(int r, int c) {
+    if(r == rows && c == cols) return;
+    vector<Cell> kept((size_t)r * c, BLANK);
+    for(int y = 0; y < min(r, rows); y++) {
+        copy_n(next.begin() + (size_t)y * cols, min(c, cols), kept.begin() + (size_t)y * c);
+    }
+    next.swap(kept);
+    prev.assign((size_t)r * c, BLANK);
+    rows = r;
+    cols = c;
+    scrolls.clear();
+    repaint = true;
+}
+
+void Screen::invalidate() {
+    repaint = true;
+}
+
+void Screen::clearRow(int y) {
+    if(y < 0 || y >= rows) return;
+    fill(next.begin() + (size_t)y * cols, next.begin() + (size_t)(y + 1) * cols, BLANK);
+}
+
+void Screen::scroll(int top, int bottom, int n) {
+    top = max(top, 0);
+    bottom = min(bottom, rows);
+    if(n == 0 || top >= bottom) return;
+    Scroll s = {top, bottom, n};
+    scrollCells(next, s);
+    scrolls.push_back(s);
+}
+
+void Screen::scrollCells(vector<Cell>& cells, const Scroll& s) {
+    auto row = [&](int y) { return cells.begin() + (size_t)y * cols; };
+    int height = s.bottom - s.top, n = min(abs(s.n), height);
+    if(s.n > 0) {
+        copy(row(s.top + n), row(s.bottom), row(s.top));
+        fill(row(s.bottom - n), row(s.bottom), BLANK);
+    } else {
+        copy_backward(row(s.top), row(s.bottom - n), row(s.bottom));
+        fill(row(s.top), row(s.top + n), BLANK);
+    }
+}
+
+void Screen::put(int y, int x, char ch, uint8_t style) {
+    if(y < 0 || y >= rows || x < 0 || x >= cols) return;
+    Cell c;
+    c.text[0] = ch;
+    c.style = style;
+    next[(size_t)y * cols + x] = c;
+}
+
+void Screen::putGlyph(int y, int x, string_view glyph, int width, uint8_t style) {
+    if(y < 0 || y >= rows || x < 0 || x >= cols) return;
+    if(x + width > cols) {
+        put(y, x, ' ', style);
+        return;
+    }
+    // An unusually long cluster keeps as many whole characters as fit
+    size_t len = min(glyph.size(), sizeof(Cell::text));
+    while(len < glyph.size() && len > 1 && (glyph[len] & 0xC0) == 0x80) len--;
+
+    Cell c;
+    memcpy(c.text, glyph.data(), len);
+    c.len = len;
+    c.style = style;
+    next[(size_t)y * cols + x] = c;
+
+    Cell covered; // the columns it covers past the first
+    covered.text[0] = 0;
+    covered.len = 0;
+    covered.style = style;
+    for(int i = 1; i < width; i++) next[(size_t)y * cols + x + i] = covered;
+}
+
+void Screen::text(int y, int x, const string& s, uint8_t style) {
+    for(size_t i = 0; i < s.size();) {
+        int width;
+        size_t len = clusterLength(s.data(), s.size(), i, width);
+        if(len == 1 && (unsigned char)s[i] < 0x80) put(y, x, s[i], style);
+        else putGlyph(y, x, string_view(s).substr(i, len), width, style);
+        i += len;
+        x += width;
+    }
+}
+
+void Screen::present(FrameBuffer& out, const vector<string>& palette, int cursorY, int cursorX) {
+    // Any change is made with the cursor hidden (no flicker while cells change)
+    // and, where supported, as one synchronized update (no half-drawn frames)
+    bool updating = false;
+    auto beginUpdate = [&]() {
+        if(updating) return;
+        if(synchronizedOutput) out.append("\x1b[?2026h");
+        out.append("\x1b[?25l");
+        updating = true;
+    };
+
+    if(repaint) {
+        beginUpdate();
+        out.append("\x1b[m\x1b[H\x1b[2J"); // reset colors, clear
+        fill(prev.begin(), prev.end(), BLANK);
+        curY = curX = 0;
+        curStyle = 0;
+        repaint = false;
+        scrolls.clear();
+    }
+
+    // Let the terminal move the rows that only moved. Scrolling a region
+    // further than its height is just a clear, which the diff below does.
+    for(const Scroll& s : scrolls) {
+        if(!scrollRegions || abs(s.n) >= s.bottom - s.top) continue;
+        beginUpdate();
+        setStyle(out, palette, 0); // rows scrolled in take the current background
+        out.append("\x1b[");
+        out.appendNumber(s.top + 1);
+        out.append(';');
+        out.appendNumber(s.bottom);
+        out.append("r\x1b[");
+        out.appendNumber(abs(s.n));
+        out.append(s.n > 0 ? 'S' : 'T');
+        out.append("\x1b[r"); // back to the whole screen; this also homes the cursor
+        curY = curX = 0;
+        scrollCells(prev, s);
+    }
+    scrolls.clear();
+
+    for(int y = 0; y < rows; y++) {
+        const Cell* n = &next[(size_t)y * cols];
+        Cell* p = &prev[(size_t)y * cols];
+        if(equal(n, n + cols, p)) continue;
+        beginUpdate();
+
+        // A row that now ends in blanks is cleared with one erase-to-end
+        int end = cols;
+        while(end > 0 && n[end - 1] == BLANK) end--;
+        int oldEnd = cols;
+        while(oldEnd > end && p[oldEnd - 1] == BLANK) oldEnd--;
+
+        for(int x = 0; x < end; x++) {
+            if(n[x] == p[x] || n[x].len == 0) continue; // a wide glyph's second column comes with the first
+            moveTo(out, y, x);
+            setStyle(out, palette, n[x].style);
+            out.append(string_view(n[x].text, n[x].len));
+            curX = x + (x + 1 < cols && n[x + 1].len == 0 ? 2 : 1); // == cols: the terminal is waiting to wrap
+        }
+        if(oldEnd > end) {
+            moveTo(out, y, end);
+            setStyle(out, palette, 0); // erased cells take the current background
+            out.append("\x1b[K");
+        }
+        copy(n, n + cols, p);
+    }
+
+    moveTo(out, cursorY, cursorX);
+    if(updating) {
+        out.append("\x1b[?25h");
+        if(synchronizedOutput) out.append("\x1b[?2026l");
+    }
+}
+
+// Picks the shortest way from the current cursor position to (y, x)
+void Screen::moveTo(FrameBuffer& out, int y, int x) {
+    if(curY == y && curX == x) return;
+
+    // A short hop forward on the same row: rewriting the unchanged cells in
+    // between is cheaper than an escape sequence, if they share the style
+    if(curY == y && curX >= 0 && curX < x && x - curX <= 4) {
+        const Cell* row = &next[(size_t)y * cols];
+        bool sameStyle = all_of(row + curX, row + x, [&](const Cell& c) { return c.style == curStyle; });
+        if(sameStyle) {
+            for(int i = curX; i < x; i++) out.append(string_view(row[i].text, row[i].len));
+            curX = x;
+            return;
+        }
+    }
+
+    if(curY >= 0 && y == curY + 1 && x == 0) out.append("\r\n");
+    else if(curY == y && curX >= 0) {
+        out.append("\x1b[");
+        out.appendNumber(x + 1);
+        out.append('G');
+    } else {
+        out.append("\x1b[");
+        out.appendNumber(y + 1);
+        if(x > 0) {
+            out.append(';');
+            out.appendNumber(x + 1);
+        }
+        out.append('H');
+    }
+    curY = y;
+    curX = x;
+}
+
+void Screen::setStyle(FrameBuffer& out, const vector<string>& palette, int style) {
+    if(style == curStyle) return;
+    out.append(palette[style]);
+    curStyle = style;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "framebuffer.h"
+using namespace std;
+
+// Model of the terminal contents. Each frame is drawn into a grid of cells
+// (a glyph and a style index) and present() compares it with the grid sent
+// last time, emitting only the runs of cells that changed, with the cheapest
+// cursor movement between them and an erase-to-end-of-line for rows that now
+// end in blanks. An unchanged frame costs nothing but the cursor position.
+// Rows moved with scroll() are moved on the terminal too, with a scroll region
+// (DECSTBM) and SU/SD, so only the rows scrolled into view are sent; without
+// scroll regions the moved rows are simply sent again.
+class Screen {
+    public:
+        struct Cell {
+            char text[14] = {' '}; // UTF-8 of the glyph drawn here, zero padded
+            uint8_t len = 1;       // bytes in text; 0 for the second column of a wide glyph
+            uint8_t style = 0;     // index into the palette passed to present()
+
+            bool operator==(const Cell& o) const { return memcmp(this, &o, sizeof(Cell)) == 0; }
+            bool operator!=(const Cell& o) const { return !(*this == o); }
+        };
+
+        void resize(int rows, int cols); // keeps the cells that still fit, forces a full repaint
+        void invalidate();               // the terminal contents are unknown, repaint everything
+        void clearRow(int y);            // cells keep what was drawn until cleared or overwritten
+        // Moves the contents of rows [top, bottom) up by n rows (down if n < 0);
+        // the rows that come into view are blank
+        void scroll(int top, int bottom, int n);
+        void useScrollRegions(bool on) { scrollRegions = on; }
+        void useSynchronizedOutput(bool on) { synchronizedOutput = on; } // mode 2026: frames appear at once
+        void put(int y, int x, char ch, uint8_t style);
+        // A glyph (one grapheme cluster) taking width columns; one that doesn't
+        // fit before the right edge is drawn as a blank
+        void putGlyph(int y, int x, string_view glyph, int width, uint8_t style);
+        void text(int y, int x, const string& s, uint8_t style);
+
+        // Sends the changes since the last frame. palette[s] is the escape
+        // sequence that selects style s; style 0 must be the default colors.
+        void present(FrameBuffer& out, const vector<string>& palette, int cursorY, int cursorX);
+
+    private:
+        struct Scroll {
+            int top, bottom, n;
+        };
+
+        void scrollCells(vector<Cell>& cells, const Scroll& s);
+        void moveTo(FrameBuffer& out, int y, int x);
+        void setStyle(FrameBuffer& out, const vector<string>& palette, int style);
+
+        int rows = 0, cols = 0;
+        vector<Cell> next, prev;
+        bool repaint = true;
+        bool scrollRegions = false;
+        bool synchronizedOutput = false;
+        vector<Scroll> scrolls; // since the last frame, in order
+        int curY = -1, curX = -1; // where the terminal cursor is, -1 if unknown
+        int curStyle = -1;        // style the terminal is in, -1 if unknown
+};
@@ -7,8 +7,18 @@
 using namespace std;
 namespace fs = std::filesystem;
 
+// Looks every color up once, so drawing only indexes the table
+static Theme compiled(Theme theme) {
+    auto color = [&](const string& type) {
+        auto it = theme.colors.find(type);
+        return "\x1b[0;" + (it != theme.colors.end() ? it->second : string("39")) + "m";
+    };
+    theme.escapes = {"\x1b[m", color("keyword"), color("number"), color("string"), color("comment")};
+    return theme;
+}
+
 Language Syntax::currentLanguage;
-Theme Syntax::currentTheme;
+Theme Syntax::currentTheme = compiled(Theme());
 
 static fs::path s_exeDir;
 static fs::path resolveSubdir(const string& subdir) {
@@ -44,8 +54,10 @@ void Syntax::setExecutablePath(const std::string& argv0) {
 }
 
 void Syntax::loadLanguage(const string& filename) {
-    string ext = filename.substr(filename.find_last_of('.'));
     currentLanguage = {};
+    size_t dot = filename.find_last_of('.');
+    if(dot == string::npos) return; // no extension, e.g. a pipe or device
+    string ext = filename.substr(dot);
 
     fs::path langDir = resolveSubdir("languages");
     std::error_code ec;
@@ -80,46 +92,38 @@ void Syntax::loadTheme(const string& filename) {
     file >> data;
     currentTheme.name = data["name"];
     currentTheme.colors = data["colors"].get<map<string, string>>();
+    currentTheme = compiled(currentTheme);
 }
 
-void Syntax::updateSyntax(vector<string>& rows, vector<vector<int>>& hl, int row) {
-    if(row >= (int)rows.size()) return;
-    if((int)hl.size() <= row) hl.resize(row + 1);
-    string& line = rows[row];
-    hl[row].assign(line.size(), 0);
-
-    auto color = [&](const string& type) -> string {
-        auto it = currentTheme.colors.find(type);
-        if(it != currentTheme.colors.end()) return "\x1b[" + it->second + "m";
-        return "\x1b[39m";
-    };
+void Syntax::updateSyntax(string_view line, vector<uint8_t>& hl) {
+    hl.assign(line.size(), HL_NORMAL);
 
     for(auto& kw : currentLanguage.keywords) {
         size_t pos = line.find(kw);
         while(pos != string::npos) {
             if((pos == 0 || !isalnum(line[pos - 1])) &&
                 (pos + kw.size() == line.size() || !isalnum(line[pos + kw.size()]))) {
-                for(size_t i = pos; i < pos + kw.size(); i++) hl[row][i] = 1;        
+                for(size_t i = pos; i < pos + kw.size(); i++) hl[i] = HL_KEYWORD;        
             }
             pos = line.find(kw, pos + 1);
         }
     }
 
     for(size_t i = 0; i < line.size(); i++) {
-        if(isdigit(line[i])) hl[row][i] = 2;
+        if(isdigit(line[i])) hl[i] = HL_NUMBER;
     }
 
     bool inString = false;
     for(size_t i = 0; i < line.size(); i++) {
         if(line[i] == '"') {
-            hl[row][i] = 3;
+            hl[i] = HL_STRING;
             inString = !inString;
-        } else if(inString) hl[row][i] = 3;
+        } else if(inString) hl[i] = HL_STRING;
     }
 
-    string commentStart = currentLanguage.singleLineComments;
-    size_t commentPos = line.find(commentStart);
+    const string& commentStart = currentLanguage.singleLineComments;
+    size_t commentPos = commentStart.empty() ? string::npos : line.find(commentStart);
     if(commentPos != string::npos) {
-        for(size_t i = commentPos; i < line.size(); i++) hl[row][i] = 4;
+        for(size_t i = commentPos; i < line.size(); i++) hl[i] = HL_COMMENT;
     }
 }
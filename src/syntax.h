@@ -1,5 +1,8 @@
 #pragma once
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include "json.hpp"
@@ -13,9 +16,13 @@ struct Language {
     string singleLineComments;
 };
 
+// Token classes produced by updateSyntax
+enum HighlightType : uint8_t { HL_NORMAL, HL_KEYWORD, HL_NUMBER, HL_STRING, HL_COMMENT, HL_TYPES };
+
 struct Theme {
     string name;
     map<string, string> colors;
+    array<string, HL_TYPES> escapes; // SGR sequence for each token class, built when the theme loads
 };
 
 class Syntax {
@@ -25,5 +32,5 @@ class Syntax {
         static void setExecutablePath(const std::string& argv0);
         static void loadLanguage(const string& filename);
         static void loadTheme(const string& filename);
-        static void updateSyntax(vector<string>& rows, vector<vector<int>>& hl, int row);
+        static void updateSyntax(string_view line, vector<uint8_t>& hl);
 };
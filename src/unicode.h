@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+static const uint32_t REPLACEMENT_CHAR = 0xFFFD;
+
+// Decodes the UTF-8 sequence at s[i] (i < len) and advances i past it. A byte
+// that doesn't start a valid sequence decodes to REPLACEMENT_CHAR on its own.
+uint32_t decodeUtf8(const char* s, size_t len, size_t& i);
+void appendUtf8(string& out, uint32_t cp);
+
+// Terminal columns a code point takes: 2 for East Asian wide and fullwidth
+// characters, 0 for combining marks and other zero-width characters, else 1.
+// Control characters count 1, as the editor draws them as '?'.
+int codepointWidth(uint32_t cp);
+
+// Bytes in the grapheme cluster (a base character with the combining marks,
+// joiners and modifiers that follow it) starting at s[i]; width is set to the
+// columns it takes. A cluster starting with a zero-width character takes one.
+size_t clusterLength(const char* s, size_t len, size_t i, int& width);
@@ -0,0 +1,64 @@
+#include "widthmap.h"
+#include "unicode.h"
+#include <algorithm>
+using namespace std;
+
+void WidthMap::clear() {
+    ascii = true;
+    whole = false;
+    mapped = 0;
+    columns = 0;
+    starts.clear();
+}
+
+void WidthMap::extend(string_view line, size_t upTo, bool lineEnd) {
+    size_t end = lineEnd ? line.size() : min(upTo, line.size());
+    size_t i = mapped;
+
+    // Fast path: one column per byte until something else shows up (or a
+    // character that may carry combining marks)
+    if(ascii) {
+        auto plain = [&](size_t k) { return (unsigned char)line[k] < 0x80 && line[k] != '\t'; };
+        while(i < end && plain(i) && (i + 1 == line.size() || (unsigned char)line[i + 1] < 0x80)) i++;
+        columns += i - mapped;
+        mapped = i;
+        if(i < end) {
+            ascii = false;
+            starts.reserve(i + 64);
+            for(size_t k = 0; k < i; k++) starts.push_back({(int)k, (int)k});
+        }
+    }
+
+    while(i < end) {
+        int width;
+        size_t len = 1;
+        if(line[i] == '\t') width = TAB_STOP - columns % TAB_STOP;
+        else len = clusterLength(line.data(), line.size(), i, width);
+        starts.push_back({(int)i, columns});
+        i += len;
+        columns += width;
+    }
+    mapped = max(mapped, i);
+    if(lineEnd) whole = true;
+}
+
+WidthMap::Glyph WidthMap::glyph(size_t i) const {
+    if(ascii) return {(int)i, (int)i};
+    if(i < starts.size()) return starts[i];
+    return {(int)mapped, columns};
+}
+
+size_t WidthMap::glyphAt(size_t byte) const {
+    if(byte >= mapped) return glyphs();
+    if(ascii) return byte;
+    auto it = upper_bound(starts.begin(), starts.end(), byte, [](size_t b, const Glyph& g) { return b < (size_t)g.byte; });
+    return it - starts.begin() - 1;
+}
+
+size_t WidthMap::glyphAtColumn(int col) const {
+    if(col >= columns) return glyphs();
+    if(col < 0) return 0;
+    if(ascii) return col;
+    auto it = upper_bound(starts.begin(), starts.end(), col, [](int c, const Glyph& g) { return c < g.col; });
+    return it - starts.begin() - 1;
+}
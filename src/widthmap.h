@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+static const int TAB_STOP = 4; // same as the indent the Tab key inserts
+
+// Maps the bytes of one line to the display columns they take: tabs run to the
+// next tab stop and a grapheme cluster takes the width of its base character.
+// It is built lazily from the start of the line, only as far as it is needed,
+// and lines of plain ASCII without tabs (most of them) are mapped one to one
+// without storing anything.
+class WidthMap {
+    public:
+        struct Glyph {
+            int byte; // where the cluster starts in the line
+            int col;  // the column it starts at
+        };
+
+        void clear();
+        // Maps the line further, up to at least byte upTo. line is the start of
+        // the line (the whole line if lineEnd); it needs a little room past upTo
+        // to see where the last cluster ends.
+        void extend(string_view line, size_t upTo, bool lineEnd);
+
+        size_t bytes() const { return mapped; }
+        int width() const { return columns; }
+        bool complete() const { return whole; } // the whole line is mapped
+
+        size_t glyphs() const { return ascii ? mapped : starts.size(); }
+        Glyph glyph(size_t i) const; // glyph(glyphs()) is the end of the mapped part
+        size_t glyphAt(size_t byte) const;   // the glyph containing byte, glyphs() past the end
+        size_t glyphAtColumn(int col) const; // the glyph covering col, glyphs() past the end
+        int column(size_t byte) const { return glyph(glyphAt(byte)).col; }
+
+    private:
+        bool ascii = true;
+        bool whole = false;
+        size_t mapped = 0;
+        int columns = 0;
+        vector<Glyph> starts; // only once the line stops being plain ASCII
+};
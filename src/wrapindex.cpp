@@ -0,0 +1,24 @@
+#include "wrapindex.h"
+#include <algorithm>
+using namespace std;
+
+void wrapLine(const WidthMap& w, string_view line, int width, vector<int>& breaks) {
+    breaks.clear();
+    size_t glyphs = w.glyphs(), start = 0;
+    while(true) {
+        int startCol = w.glyph(start).col;
+        if(w.width() - startCol < width) break; // the rest fits, and the cursor after it
+        size_t end = max(w.glyphAtColumn(startCol + width), start + 1); // the first glyph that doesn't fit
+        if(end < glyphs && line[w.glyph(end).byte] != ' ') {
+            // Break after the last space instead, unless the word fills the line
+            for(size_t k = end; k > start + 1; k--) {
+                if(line[w.glyph(k - 1).byte] == ' ') {
+                    end = k;
+                    break;
+                }
+            }
+        }
+        breaks.push_back((int)end);
+        start = end;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "widthmap.h"
+#include "rowindex.h"
+using namespace std;
+
+// Where the visual lines of a soft-wrapped line start: the glyph index of every
+// visual line after the first. Lines break after the last space that fits (in
+// the middle of words longer than the width). A line that exactly fills its
+// last visual line gets an empty one after it, so the cursor at its end stays
+// on screen. w must map the whole line.
+void wrapLine(const WidthMap& w, string_view line, int width, vector<int>& breaks);
+
+// How many visual lines every row of the document takes with soft wrap on,
+// and the visual line every row starts at
+class WrapIndex {
+    public:
+        void clear() { index.clear(); }
+        int rows() const { return index.rows(); }
+        size_t lines() const { return index.total(0); }
+
+        // Rows [y, y + oldCount) were replaced by rows taking these many lines
+        void splice(int y, int oldCount, const vector<uint32_t>& counts) { index.splice(y, oldCount, counts); }
+        void set(int y, uint32_t count) { index.set(y, max(count, 1u)); }
+        uint32_t count(int y) const { return index.get(y); }
+        size_t lineOf(int y) const { return index.sumBefore(y, 0); } // the visual line row y starts at
+        // The row visual line `line` is in (the last row past the end); start
+        // is set to the visual line that row starts at
+        int rowAt(size_t line, size_t& start) const { return index.find(0, line, start); }
+
+    private:
+        struct Lines {
+            static constexpr int COUNT = 1;
+            static void expand(uint32_t count, size_t out[]) { out[0] = count; }
+        };
+        RowIndex<Lines> index;
+};
@@ -0,0 +1,170 @@
+// Edits both text storages at random and after each step compares every query
+// with a plain string holding the same document: sizes, line starts and
+// lengths (CRLF included), offset -> line lookups, substrings and the written
+// file. Also covers contents attached without copying and indexed lazily.
+#include "piecetable.h"
+#include "rope.h"
+#include "check.h"
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// The document as the buffer should see it
+struct Model {
+    string text;
+
+    vector<size_t> starts() const {
+        vector<size_t> s = {0};
+        for(size_t i = 0; i < text.size(); i++) {
+            if(text[i] == '\n') s.push_back(i + 1);
+        }
+        return s;
+    }
+};
+
+template<class Buffer>
+static string written(const Buffer& b) {
+    ostringstream out;
+    b.write(out);
+    return out.str();
+}
+
+// Every line with all, otherwise a sample of them
+template<class Buffer>
+static void compare(const Buffer& b, const Model& m, mt19937& rng, bool all = true) {
+    vector<size_t> starts = m.starts();
+    CHECK_EQ(b.size(), m.text.size());
+    CHECK_EQ(b.lineCount(), (int)starts.size());
+    for(size_t k = 0; k < (all ? starts.size() : 20); k++) {
+        size_t y = all ? k : rng() % starts.size();
+        size_t end = y + 1 < starts.size() ? starts[y + 1] - 1 : m.text.size();
+        if(end > starts[y] && y + 1 < starts.size() && m.text[end - 1] == '\r') end--;
+        CHECK_EQ(b.lineStart(y), starts[y]);
+        CHECK_EQ(b.lineLength(y), (int)(end - starts[y]));
+        CHECK_EQ(b.line(y), m.text.substr(starts[y], end - starts[y]));
+        string scratch;
+        CHECK_EQ(string(b.lineView(y, scratch)), b.line(y));
+    }
+    for(int k = 0; k < 20 && !m.text.empty(); k++) {
+        size_t pos = rng() % m.text.size();
+        int y = upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+        CHECK_EQ(b.lineOf(pos), y);
+        CHECK_EQ(b.charAt(pos), m.text[pos]);
+        size_t len = rng() % 64;
+        CHECK_EQ(b.substr(pos, len), m.text.substr(pos, len));
+    }
+    CHECK_EQ(written(b), m.text);
+}
+
+static string randomText(mt19937& rng, size_t maxLen) {
+    static const char* pieces[] = {"a", "b", "xyz", " ", "\n", "\r\n", "\t", "long line of words "};
+    string s;
+    size_t len = rng() % (maxLen + 1);
+    while(s.size() < len) s += pieces[rng() % size(pieces)];
+    return s;
+}
+
+// Random inserts and erases, with runs of typing and backspacing at one spot
+// the way the editor sends them
+template<class Buffer>
+static void randomEdits(unsigned seed) {
+    mt19937 rng(seed);
+    Buffer b;
+    Model m;
+    m.text = randomText(rng, 2000);
+    b.load(m.text);
+    compare(b, m, rng);
+
+    for(int step = 0; step < 400 && !s_failures; step++) {
+        size_t pos = m.text.empty() ? 0 : rng() % (m.text.size() + 1);
+        switch(rng() % 4) {
+            case 0: { // insert
+                string s = randomText(rng, 40);
+                b.insert(pos, s);
+                m.text.insert(pos, s);
+                break;
+            }
+            case 1: { // erase
+                size_t len = min((size_t)(rng() % 80), m.text.size() - pos);
+                b.erase(pos, len);
+                m.text.erase(pos, len);
+                break;
+            }
+            case 2: // typing: one character after the other
+                for(int k = 0; k < 20; k++) {
+                    string ch(1, "ab \n"[rng() % 4]);
+                    b.insert(pos + k, ch);
+                    m.text.insert(pos + k, ch);
+                }
+                break;
+            case 3: // backspacing
+                for(int k = 0; k < 20 && pos > 0; k++, pos--) {
+                    b.erase(pos - 1, 1);
+                    m.text.erase(pos - 1, 1);
+                }
+                break;
+        }
+        compare(b, m, rng, step % 10 == 9);
+    }
+}
+
+// Attached contents join the document as their lines get indexed, a chunk at
+// a time; the part not indexed yet is still written out as is
+template<class Buffer>
+static void attachedEdits() {
+    string text;
+    int lines = 0;
+    for(; text.size() < LineIndexer::CHUNK * 3 / 2; lines++) text += "line " + to_string(lines) + (lines % 7 == 6 ? "\r\n" : "\n");
+    text.resize(text.size() - (text[text.size() - 2] == '\r' ? 2 : 1)); // no final break, as the editor attaches files
+
+    Buffer b;
+    b.attach(text.data(), text.size());
+    b.indexLines(10);
+    CHECK(!b.indexed());
+    CHECK(b.lineCount() >= 10 && b.lineCount() < lines);
+    CHECK_EQ(b.line(3), "line 3");
+    string expected = text;
+    b.insert(b.lineStart(2), "new ");
+    expected.insert(expected.find("line 2"), "new ");
+    CHECK_EQ(b.line(2), "new line 2");
+    CHECK_EQ(written(b), expected);
+
+    b.indexLines(INT_MAX);
+    CHECK(b.indexed());
+    CHECK_EQ(b.lineCount(), lines);
+    CHECK_EQ(b.line(lines - 1), "line " + to_string(lines - 1));
+    CHECK_EQ(b.line(6), "line 6"); // ended by CRLF
+    CHECK_EQ(written(b), expected);
+    b.erase(0, b.lineStart(1));
+    expected.erase(0, expected.find('\n') + 1);
+    CHECK_EQ(b.lineCount(), lines - 1);
+    CHECK_EQ(written(b), expected);
+}
+
+template<class Buffer>
+static void testBuffer() {
+    for(unsigned seed = 1; seed <= 8 && !s_failures; seed++) randomEdits<Buffer>(seed);
+    attachedEdits<Buffer>();
+
+    // An empty document has one empty line
+    Buffer b;
+    b.load("");
+    CHECK_EQ(b.lineCount(), 1);
+    CHECK_EQ(b.lineLength(0), 0);
+    b.insert(0, "\n");
+    CHECK_EQ(b.lineCount(), 2);
+    b.erase(0, 1);
+    CHECK_EQ(b.lineCount(), 1);
+    CHECK_EQ(b.size(), (size_t)0);
+}
+
+int main() {
+    testBuffer<PieceTable>();
+    testBuffer<Rope>();
+    return testResult();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <iostream>
+using namespace std;
+
+// Just enough of a test framework for the unit tests: a failed CHECK reports
+// the expression and where it is, and the test goes on; main returns
+// testResult() so ctest sees the failures.
+static int s_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            s_failures++; \
+        } \
+    } while(0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        auto&& a_ = (a); \
+        auto&& b_ = (b); \
+        if(!(a_ == b_)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " << a_ << " != " << b_ << "\n"; \
+            s_failures++; \
+        } \
+    } while(0)
+
+static int testResult() {
+    if(s_failures) cerr << s_failures << " check(s) failed\n";
+    return s_failures ? 1 : 0;
+}
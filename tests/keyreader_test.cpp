@@ -0,0 +1,258 @@
+// Feeds KeyReader what terminals send, through a pipe as from the tty: plain
+// and control bytes, CSI and SS3 keys with and without modifiers, Alt as an
+// ESC prefix, UTF-8, replies that aren't keys, a lone Escape that times out,
+// sequences split across reads and across the end of the ring buffer,
+// bracketed pastes whose end marker comes in pieces, and when keys arrived.
+#include "keyreader.h"
+#include "check.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// A pipe standing in for the terminal
+struct Terminal {
+    int fds[2] = {-1, -1};
+
+    Terminal() {
+        CHECK(pipe(fds) == 0);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    }
+    ~Terminal() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    // Sends bytes and lets keys read all of them (a read stops at the end of the ring)
+    void send(KeyReader& keys, const string& bytes) {
+        CHECK(write(fds[1], bytes.data(), bytes.size()) == (ssize_t)bytes.size());
+        int waiting = 0;
+        for(int reads = 0; reads < 4 && ioctl(fds[0], FIONREAD, &waiting) == 0 && waiting > 0; reads++) keys.fill(fds[0]);
+    }
+};
+
+// Every key the bytes decode to, as sent in one go
+static vector<int> keysOf(const string& bytes) {
+    Terminal t;
+    KeyReader keys;
+    t.send(keys, bytes);
+    vector<int> out;
+    for(int key; (key = keys.next()) != -1;) out.push_back(key);
+    return out;
+}
+
+static void checkKeys(const string& bytes, const vector<int>& expected) {
+    vector<int> got = keysOf(bytes);
+    if(got != expected) {
+        cerr << "keys of";
+        for(unsigned char c : bytes) cerr << " " << hex << (int)c << dec;
+        cerr << ":";
+        for(int k : got) cerr << " " << k;
+        cerr << "\n";
+        s_failures++;
+    }
+}
+
+static void plainKeys() {
+    checkKeys("a", {'a'});
+    checkKeys("\x11\r\x7f\t", {17, '\r', 127, '\t'});
+    checkKeys("\x1b[A\x1b[B\x1b[C\x1b[D", {ARROW_UP, ARROW_DOWN, ARROW_RIGHT, ARROW_LEFT});
+    checkKeys("\x1bOA\x1bOH\x1bOF", {ARROW_UP, HOME_KEY, END_KEY}); // SS3, as in application mode
+    checkKeys("\x1b[H\x1b[F\x1b[1~\x1b[4~\x1b[7~\x1b[8~", {HOME_KEY, END_KEY, HOME_KEY, END_KEY, HOME_KEY, END_KEY});
+    checkKeys("\x1b[2~\x1b[3~\x1b[5~\x1b[6~\x1b[Z", {INSERT_KEY, DEL_KEY, PAGE_UP, PAGE_DOWN, BACK_TAB});
+    checkKeys("\x1bOP\x1bOS\x1b[15~\x1b[24~", {F1_KEY, F1_KEY + 3, F1_KEY + 4, F1_KEY + 11});
+}
+
+static void modifiedKeys() {
+    checkKeys("\x1b[1;2A", {ARROW_UP | KEY_SHIFT});
+    checkKeys("\x1b[1;3B", {ARROW_DOWN | KEY_ALT});
+    checkKeys("\x1b[1;5C", {ARROW_RIGHT | KEY_CTRL});
+    checkKeys("\x1b[1;6F", {END_KEY | KEY_CTRL | KEY_SHIFT});
+    checkKeys("\x1b[5;5~\x1b[3;3~", {PAGE_UP | KEY_CTRL, DEL_KEY | KEY_ALT});
+    checkKeys("\x1bx\x1b\x7f", {'x' | KEY_ALT, 127 | KEY_ALT}); // Alt sends an ESC first
+    checkKeys("\x1b\x1b[A", {0x1b, ARROW_UP});
+}
+
+static void textAndReplies() {
+    checkKeys("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", {TEXT_CHAR | 0xE9, TEXT_CHAR | 0x20AC, TEXT_CHAR | 0x1F600});
+    checkKeys("\x80" "a\xc3(", {'a', '('}); // stray continuation byte, character cut short
+    checkKeys("\x1b[200~", {PASTE_START});
+
+    // The terminal answering a query isn't a key; its parameters are kept
+    Terminal t;
+    KeyReader keys;
+    t.send(keys, "\x1b[?2026;2$yq");
+    CHECK_EQ(keys.next(), (int)KEY_REPORT);
+    CHECK_EQ(keys.report(), "?2026;2$y");
+    CHECK_EQ(keys.peek(), 'q');
+    CHECK_EQ(keys.next(), 'q');
+    CHECK_EQ(keys.next(), -1);
+}
+
+// Every way a key can be cut in two by the reads: nothing comes out until the
+// rest arrives, and then exactly the key
+static void splitReads() {
+    vector<pair<string, int>> cases = {
+        {"\x1b[1;5C", ARROW_RIGHT | KEY_CTRL}, {"\x1bOQ", F1_KEY + 1}, {"\x1b[24~", F1_KEY + 11},
+        {"\xf0\x9f\x98\x80", TEXT_CHAR | 0x1F600}, {"\x1b[200~", PASTE_START},
+    };
+    for(auto& [bytes, key] : cases) {
+        for(size_t cut = 1; cut < bytes.size(); cut++) {
+            Terminal t;
+            KeyReader keys;
+            t.send(keys, bytes.substr(0, cut));
+            CHECK_EQ(keys.next(), -1);
+            CHECK(keys.pending());
+            CHECK(keys.timeLeft() >= 0);
+            t.send(keys, bytes.substr(cut));
+            CHECK_EQ(keys.next(), key);
+            CHECK_EQ(keys.next(), -1);
+            CHECK_EQ(keys.timeLeft(), -1);
+        }
+    }
+}
+
+// An ESC with nothing after it is the Escape key once ESC_TIMEOUT has passed
+static void escapeTimeout() {
+    Terminal t;
+    KeyReader keys;
+    t.send(keys, "\x1b");
+    CHECK_EQ(keys.next(), -1);
+    int left = keys.timeLeft();
+    CHECK(left > 0 && left <= (int)KeyReader::ESC_TIMEOUT.count());
+    this_thread::sleep_for(KeyReader::ESC_TIMEOUT + chrono::milliseconds(5));
+    CHECK_EQ(keys.timeLeft(), 0);
+    CHECK_EQ(keys.flush(), 0x1b);
+    CHECK(!keys.pending());
+
+    t.send(keys, "\x1b[");
+    CHECK_EQ(keys.next(), -1);
+    CHECK_EQ(keys.flush(), '[' | KEY_ALT);
+    t.send(keys, "b");
+    CHECK_EQ(keys.next(), 'b');
+}
+
+// Keys keep coming out right as the ring buffer wraps around under them
+static void ringWrap() {
+    Terminal t;
+    KeyReader keys;
+    const string seq = "\x1b[1;5Dx\xe2\x82\xac"; // 10 bytes, so sequences straddle the end
+    int decoded = 0, expected = 0;
+    for(int round = 0; round < 40; round++) {
+        string burst;
+        for(int k = 0; k < 200; k++) burst += seq;
+        t.send(keys, burst);
+        expected += 600;
+        for(int key; (key = keys.next()) != -1; decoded++) {
+            int want = decoded % 3 == 0 ? (ARROW_LEFT | KEY_CTRL) : decoded % 3 == 1 ? 'x' : (TEXT_CHAR | 0x20AC);
+            if(key != want) {
+                CHECK_EQ(key, want);
+                return;
+            }
+        }
+    }
+    CHECK_EQ(decoded, expected);
+}
+
+// After PASTE_START everything up to the end marker is text, as is, however
+// the reads cut it up
+static void pastes() {
+    const string end = "\x1b[201~";
+    {
+        Terminal t;
+        KeyReader keys;
+        t.send(keys, "\x1b[200~one\rtwo\x1b[A\t" + end + "z");
+        CHECK_EQ(keys.next(), (int)PASTE_START);
+        string text;
+        CHECK(keys.paste(text));
+        CHECK_EQ(text, "one\rtwo\x1b[A\t"); // keys inside a paste are text
+        CHECK_EQ(keys.next(), 'z');
+    }
+
+    // The end marker split across two reads at every byte
+    for(size_t cut = 0; cut <= end.size(); cut++) {
+        Terminal t;
+        KeyReader keys;
+        t.send(keys, "\x1b[200~abc" + end.substr(0, cut));
+        CHECK_EQ(keys.next(), (int)PASTE_START);
+        string text;
+        bool done = keys.paste(text);
+        CHECK_EQ(done, cut == end.size());
+        CHECK_EQ(text, "abc"); // a possible start of the marker is held back
+        t.send(keys, end.substr(cut) + "q");
+        if(!done) CHECK(keys.paste(text));
+        CHECK_EQ(text, "abc");
+        CHECK_EQ(keys.next(), 'q');
+    }
+
+    // Text that looks like the start of the marker but goes on differently
+    {
+        Terminal t;
+        KeyReader keys;
+        t.send(keys, "\x1b[200~x\x1b[20");
+        CHECK_EQ(keys.next(), (int)PASTE_START);
+        string text;
+        CHECK(!keys.paste(text));
+        CHECK_EQ(text, "x");
+        t.send(keys, "0~y\x1b[201");
+        CHECK(!keys.paste(text));
+        t.send(keys, "~");
+        CHECK(keys.paste(text));
+        CHECK_EQ(text, "x\x1b[200~y");
+    }
+
+    // A paste many times the size of the ring buffer, taken as it arrives
+    {
+        Terminal t;
+        KeyReader keys;
+        string pasted;
+        for(int i = 0; pasted.size() < KeyReader::SIZE * 6; i++) pasted += "line " + to_string(i) + (i % 9 ? "\r" : "\x1b\r");
+        string sent = "\x1b[200~" + pasted + end + "!";
+        string text;
+        bool started = false, done = false;
+        for(size_t at = 0; at < sent.size(); at += 3001) {
+            t.send(keys, sent.substr(at, 3001));
+            if(!started) CHECK(started = keys.next() == PASTE_START);
+            if(!done) done = keys.paste(text);
+        }
+        CHECK(done);
+        CHECK(text == pasted);
+        CHECK_EQ(keys.next(), '!');
+    }
+}
+
+// Keys that came in one read arrived together, however long they stay
+// buffered; a key split across reads arrived with its last byte
+static void arrivalTimes() {
+    Terminal t;
+    KeyReader keys;
+    t.send(keys, "\x1b[B\x1b[Bx\x1b[");
+    this_thread::sleep_for(chrono::milliseconds(5));
+    t.send(keys, "By");
+    CHECK_EQ(keys.next(), (int)ARROW_DOWN);
+    auto first = keys.arrived();
+    CHECK_EQ(keys.next(), (int)ARROW_DOWN);
+    CHECK(keys.arrived() == first);
+    CHECK_EQ(keys.next(), 'x');
+    CHECK(keys.arrived() == first);
+    CHECK_EQ(keys.next(), (int)ARROW_DOWN);
+    auto second = keys.arrived();
+    CHECK(second - first >= chrono::milliseconds(5));
+    CHECK_EQ(keys.next(), 'y');
+    CHECK(keys.arrived() == second);
+}
+
+int main() {
+    plainKeys();
+    modifiedKeys();
+    textAndReplies();
+    splitReads();
+    escapeTimeout();
+    ringWrap();
+    pastes();
+    arrivalTimes();
+    return testResult();
+}
@@ -0,0 +1,63 @@
+// Splices rows into an Overview at random between partial summarizing passes
+// and checks that only rows not summarized yet are handed out, each once,
+// and that every row ends up summarized with its own class.
+#include "overview.h"
+#include "check.h"
+#include <random>
+#include <vector>
+using namespace std;
+
+// The class a row is summarized as, told by its length
+static uint8_t typeOf(size_t length) {
+    return length % HL_TYPES;
+}
+
+// Summarizes up to `budget` rows the way the editor does when idle
+static void summarize(Overview& o, vector<bool>& done, int budget) {
+    for(int y; budget-- > 0 && (y = o.nextPending()) >= 0;) {
+        if(done[y]) {
+            CHECK(!done[y]); // summarized already
+            return;
+        }
+        size_t length = o.bucket(y, y + 1).bytes;
+        o.summarize(y, {typeOf(length)});
+        done[y] = true;
+    }
+}
+
+static void checkAll(Overview& o, vector<bool>& done) {
+    summarize(o, done, o.rows() + 1);
+    CHECK(!o.pending());
+    CHECK_EQ(o.nextPending(), -1);
+    for(int y = 0; y < o.rows(); y++) {
+        CHECK(done[y]);
+        Overview::Bucket b = o.bucket(y, y + 1);
+        CHECK_EQ((int)b.type, (int)typeOf(b.bytes));
+    }
+}
+
+int main() {
+    mt19937 rng(20);
+    for(int round = 0; round < 4 && !s_failures; round++) {
+        Overview o;
+        vector<bool> done;
+        for(int step = 0; step < 200 && !s_failures; step++) {
+            int r = rng() % 10;
+            int y = rng() % (o.rows() + 1);
+            int oldCount = r == 0 ? o.rows() - y : rng() % min(o.rows() - y + 1, 4); // r == 0: new rows at the end
+            int newCount = r == 9 ? rng() % 1500 : rng() % 4;
+            vector<uint32_t> rows(newCount);
+            for(uint32_t& w : rows) w = Overview::row(rng() % 500, rng() % 2);
+            o.splice(y, oldCount, rows);
+            done.erase(done.begin() + y, done.begin() + y + oldCount);
+            done.insert(done.begin() + y, newCount, false);
+            if(r == 1) {
+                o.restart(); // everything is summarized again
+                done.assign(done.size(), false);
+            }
+            summarize(o, done, rng() % 200);
+        }
+        checkAll(o, done);
+    }
+    return testResult();
+}
@@ -0,0 +1,102 @@
+// Splices and sets rows of a RowIndex at random and compares its running
+// totals and row lookups with a plain vector of words, across chunk splits
+// and merges.
+#include "rowindex.h"
+#include "check.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+using namespace std;
+
+// Three fields packed into a word: a 16-bit size, an 8-bit count and a flag
+// that is 0 for most rows, so lookups have rows with no share to skip
+struct Fields {
+    static constexpr int COUNT = 3;
+    static void expand(uint32_t word, size_t out[]) {
+        out[0] = word & 0xFFFF;
+        out[1] = (word >> 16) & 0xFF;
+        out[2] = word >> 31;
+    }
+};
+
+static size_t share(uint32_t word, int field) {
+    size_t out[Fields::COUNT];
+    Fields::expand(word, out);
+    return out[field];
+}
+
+static uint32_t randomWord(mt19937& rng) {
+    uint32_t word = rng() % 200 | (rng() % 4) << 16;
+    if(rng() % 8 == 0) word |= 1u << 31;
+    if(rng() % 5 == 0) word &= ~0xFFFFu; // an empty row
+    return word;
+}
+
+static void compare(const RowIndex<Fields>& index, const vector<uint32_t>& rows, mt19937& rng) {
+    CHECK_EQ(index.rows(), (int)rows.size());
+    vector<size_t> before[Fields::COUNT]; // running totals up to every row
+    for(int f = 0; f < Fields::COUNT; f++) {
+        before[f].assign(1, 0);
+        for(uint32_t w : rows) before[f].push_back(before[f].back() + share(w, f));
+        CHECK_EQ(index.total(f), before[f].back());
+    }
+
+    // every row of small indexes, a sample of large ones
+    bool all = rows.size() <= 600;
+    for(size_t k = 0; k < (all ? rows.size() + 1 : 300); k++) {
+        size_t y = all ? k : rng() % (rows.size() + 1);
+        if(y < rows.size()) CHECK_EQ(index.get(y), rows[y]);
+        size_t sums[Fields::COUNT];
+        index.sumsBefore(y, sums);
+        for(int f = 0; f < Fields::COUNT; f++) {
+            CHECK_EQ(sums[f], before[f][y]);
+            CHECK_EQ(index.sumBefore(y, f), before[f][y]);
+        }
+    }
+
+    for(int f = 0; f < Fields::COUNT; f++) {
+        size_t total = before[f].back();
+        for(int k = 0; k < 50; k++) {
+            size_t pos = rng() % (total + 3); // also at and past the end
+            int passed = upper_bound(before[f].begin() + 1, before[f].end(), pos) - before[f].begin() - 1;
+            int expected = min(passed, max((int)rows.size() - 1, 0));
+            size_t start = 0;
+            CHECK_EQ(index.find(f, pos, start), expected);
+            CHECK_EQ(start, before[f][expected]);
+        }
+    }
+}
+
+int main() {
+    mt19937 rng(20);
+    for(int round = 0; round < 10 && !s_failures; round++) {
+        RowIndex<Fields> index;
+        vector<uint32_t> rows;
+        compare(index, rows, rng);
+        for(int step = 0; step < 150 && !s_failures; step++) {
+            int r = rng() % 10;
+            if(r < 2) { // a change to one row
+                if(rows.empty()) continue;
+                int y = rng() % rows.size();
+                rows[y] = randomWord(rng);
+                index.set(y, rows[y]);
+            }
+            else { // rows replaced, inserted or removed; sometimes many, splitting or merging chunks
+                int y = rng() % (rows.size() + 1);
+                int oldCount = rng() % (rows.size() - y + 1);
+                if(r < 7) oldCount = min(oldCount, 3);
+                int newCount = r == 9 ? rng() % 1500 : rng() % 4;
+                vector<uint32_t> words(newCount);
+                for(uint32_t& w : words) w = randomWord(rng);
+                index.splice(y, oldCount, words);
+                rows.erase(rows.begin() + y, rows.begin() + y + oldCount);
+                rows.insert(rows.begin() + y, words.begin(), words.end());
+            }
+            compare(index, rows, rng);
+        }
+        index.clear();
+        rows.clear();
+        compare(index, rows, rng);
+    }
+    return testResult();
+}
@@ -0,0 +1,93 @@
+// Checks every line-break scanner this CPU can run against a plain byte loop:
+// on every start alignment and every tail length past the last whole block,
+// with breaks at block edges, and right against unmapped pages so a vector
+// load past either end of the range would fault.
+#include "linescan.h"
+#include "check.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+static vector<size_t> expectedBreaks(const char* data, size_t from, size_t to) {
+    vector<size_t> breaks;
+    for(size_t i = from; i < to; i++) {
+        if(data[i] == '\n') breaks.push_back(i);
+    }
+    return breaks;
+}
+
+static void checkRange(const char* data, size_t from, size_t to) {
+    vector<size_t> expected = expectedBreaks(data, from, to);
+    for(const LineScanner& s : lineScanners()) {
+        vector<size_t> breaks = {7}; // breaks are appended to what is there
+        s.scan(data, from, to, breaks);
+        breaks.erase(breaks.begin());
+        if(breaks != expected) {
+            cerr << s.name << ": wrong breaks in [" << from << ", " << to << ")\n";
+            s_failures++;
+        }
+    }
+}
+
+// Random text with a break about every `gap` bytes, sometimes CRLF
+static string randomText(mt19937& rng, size_t size, int gap) {
+    string text(size, ' ');
+    for(char& c : text) {
+        int r = rng() % gap;
+        c = r == 0 ? '\n' : r == 1 ? '\r' : 'a' + rng() % 26;
+    }
+    return text;
+}
+
+int main() {
+    mt19937 rng(4);
+
+    // Every start alignment and every length up to a few blocks
+    for(int gap : {2, 9, 70, 1000}) {
+        alignas(64) static char block[512];
+        string text = randomText(rng, sizeof(block), gap);
+        copy(text.begin(), text.end(), block);
+        for(size_t from = 0; from < 64; from++) {
+            for(size_t to = from; to <= from + 300; to++) checkRange(block, from, to);
+        }
+    }
+
+    // Breaks on the first and last byte of blocks, and nothing but breaks
+    alignas(64) static char edges[256];
+    fill(begin(edges), end(edges), 'a');
+    for(size_t i = 0; i < sizeof(edges); i += 64) edges[i] = edges[i + 63] = '\n';
+    for(size_t from = 0; from < 64; from++) checkRange(edges, from, sizeof(edges) - from % 7);
+    fill(begin(edges), end(edges), '\n');
+    for(size_t from = 0; from < 64; from++) checkRange(edges, from, sizeof(edges) - from % 5);
+
+    // Ranges that end at the last mapped byte or start at the first
+    long page = sysconf(_SC_PAGESIZE);
+    char* pages = (char*)mmap(nullptr, page * 3, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(pages != MAP_FAILED);
+    if(pages != MAP_FAILED) {
+        char* mapped = pages + page;
+        string text = randomText(rng, page, 9);
+        copy(text.begin(), text.end(), mapped);
+        mprotect(pages, page, PROT_NONE);
+        mprotect(mapped + page, page, PROT_NONE);
+        for(size_t len = 0; len <= 300; len++) {
+            checkRange(mapped, page - len, page);
+            checkRange(mapped, 0, len);
+        }
+        munmap(pages, page * 3);
+    }
+
+    // A large random block through the scanner the editor uses
+    string big = randomText(rng, 3 << 20, 40);
+    vector<size_t> breaks;
+    scanLineBreaks(big.data(), 3, big.size() - 5, breaks);
+    CHECK(breaks == expectedBreaks(big.data(), 3, big.size() - 5));
+    for(const LineScanner& s : lineScanners()) cout << s.name << " ";
+    cout << "checked\n";
+    return testResult();
+}